@@ -0,0 +1,30 @@
+#include <stdio.h>
+
+// recursive calls: fib and factorial
+
+int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+int factorial(int n) {
+    if (n < 2) {
+        return 1;
+    }
+    return n * factorial(n - 1) % 1000003;
+}
+
+int main() {
+    int i, sum;
+
+    sum = 0;
+    i = 0;
+    while (i < 20000) {
+        sum = (sum + factorial(i % 100)) % 1000003;
+        i++;
+    }
+    printf("fib(27) = %d, factorials = %d\n", fib(27), sum);
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// writes a synthetic program for the front end of cc (see run.sh):
+//   gen globals functions locals enums depth strings
+// every function assigns an expression of `depth` operators to each of its
+// locals, the leaves are its parameters, its locals, the globals and the
+// enum constants, and the string literals are spread over the functions
+
+int globals, functions, locals, enums, depth, strings;
+
+int number(char* s) {
+    int n;
+
+    n = 0;
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + *s++ - '0';
+    }
+    return n;
+}
+
+// the k-th leaf of an expression in function f
+void leaf(int f, int k) {
+    int r;
+
+    r = (f * 7 + k) % 5;
+    if (r == 1 && locals) {
+        printf("l%d", k % locals);
+    } else if (r == 2 && globals) {
+        printf("g%d", (f + k) % globals);
+    } else if (r == 3 && enums) {
+        printf("E%d", (f * 3 + k) % enums);
+    } else if (r == 4) {
+        printf("%d", k);
+    } else {
+        printf("a");
+    }
+}
+
+// an expression nested `depth` parentheses deep
+void expression(int f, int k) {
+    int i;
+
+    i = 0;
+    while (i < depth) {
+        printf("(");
+        i++;
+    }
+    leaf(f, k);
+    i = 0;
+    while (i < depth) {
+        printf(" %c ", "+-*&|^"[(k + i) % 6]);
+        leaf(f, k + i + 1);
+        printf(")");
+        i++;
+    }
+}
+
+void function(int f) {
+    int k;
+
+    printf("int f%d(int a, int b) {\n", f);
+    if (locals) {
+        printf("    int l0");
+        k = 1;
+        while (k < locals) {
+            printf(k % 8 ? ", l%d" : ",\n        l%d", k);
+            k++;
+        }
+        printf(";\n");
+    }
+    printf("    char* s;\n\n");
+    k = 0;
+    while (k < locals) {
+        printf("    l%d = ", k);
+        expression(f, k);
+        printf(";\n");
+        k++;
+    }
+    if (!locals) {
+        printf("    a = ");
+        expression(f, 0);
+        printf(";\n");
+    }
+    k = f;
+    while (k < strings) {
+        printf("    s = \"string %d of the program\";\n", k);
+        k = k + functions;
+    }
+    if (f > 0) {
+        printf("    if (b < 0) {\n        a = f%d(a, b + 1);\n    }\n", f - 1);
+    }
+    printf("    return %s;\n}\n\n", locals ? "l0" : "a");
+}
+
+int main(int argc, char** argv) {
+    int i;
+
+    if (argc < 7) {
+        printf("usage: gen globals functions locals enums depth strings\n");
+        return 1;
+    }
+    globals = number(argv[1]);
+    functions = number(argv[2]);
+    locals = number(argv[3]);
+    enums = number(argv[4]);
+    depth = number(argv[5]);
+    strings = number(argv[6]);
+
+    i = 0;
+    while (i < enums) {
+        printf(i % 64 ? ", E%d" : "enum { E%d", i);
+        i++;
+        if (i % 64 == 0 || i == enums) {
+            printf(" };\n");
+        }
+    }
+    i = 0;
+    while (i < globals) {
+        printf(i % 8 ? ", g%d" : "int g%d", i);
+        i++;
+        if (i % 8 == 0 || i == globals) {
+            printf(";\n");
+        }
+    }
+    printf("\n");
+    i = 0;
+    while (i < functions) {
+        function(i);
+        i++;
+    }
+    printf("int main() {\n    return f%d(1, 2) & 0;\n}\n", functions - 1);
+    return 0;
+}
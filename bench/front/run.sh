@@ -0,0 +1,54 @@
+#!/bin/sh
+# times the front end of cc alone (cc -n lexes and parses without running)
+# on programs from gen.c that grow with each scale in $SCALES, and prints the
+# tokens and lines per second and the bytes of text and data and the
+# identifiers the program needs. at each scale there are 100 globals,
+# 20 functions, 50 enum constants and 20 strings per unit of scale, and
+# $LOCALS locals per function with expressions $DEPTH operators deep.
+# SCALES="1 10 100 1000 10000" goes up to some hundreds of megabytes
+
+CC=${CC:-./cc}
+RUNS=${RUNS:-3}
+SCALES=${SCALES:-1 10 100 1000}
+LOCALS=${LOCALS:-16}
+DEPTH=${DEPTH:-8}
+TMP=${TMPDIR:-/tmp}/cc-front.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+gcc -O2 -w bench/front/gen.c -o "$TMP/gen" || exit 1
+
+printf "%-6s %10s %10s %10s %8s %10s %10s %8s %10s %8s %8s\n" scale \
+       "source" lines tokens "time" "Ktokens/s" "Klines/s" "MB/s" \
+       "text" "data" symbols
+printf "%-6s %10s %10s %10s %8s %10s %10s %8s %10s %8s %8s\n" "" \
+       "(KB)" "" "" "(ms)" "" "" "" "(KB)" "(KB)" ""
+
+for s in $SCALES; do
+    "$TMP/gen" $((100 * s)) $((20 * s)) "$LOCALS" $((50 * s)) "$DEPTH" \
+        $((20 * s)) > "$TMP/src.c" || exit 1
+    size=$(wc -c < "$TMP/src.c")
+
+    # the text takes some times the size of the source, and data its strings
+    opts="-mtext=$((8 * size + 67108864)) -mdata=$((size + 67108864))"
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        $CC -n $opts "$TMP/src.c" > "$TMP/out" 2>&1 ||
+            { cat "$TMP/out" >&2; exit 1; }
+        ms=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $ms -lt $best ]; then
+            best=$ms
+        fi
+        i=$((i + 1))
+    done
+
+    # tokens(n) lines(n) text(n) data(n) symbols(n)
+    tr '()' '  ' < "$TMP/out" | awk -v s="$s" -v size="$size" -v t="$best" '{
+        if (t < 1) t = 1
+        printf "%-6d %10d %10d %10d %8d %10.0f %10.0f %8.1f %10d %8d %8d\n",
+               s, size / 1024, $4, $2, t, $2 / t, $4 / t,
+               size / t / 1000, $6 / 1024, $8 / 1024, $10
+    }'
+done
@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// nested loops over integer matrices, stored by rows
+
+int* matrix(int n, int seed) {
+    int *m, i;
+
+    m = malloc(n * n * sizeof(int));
+    i = 0;
+    while (i < n * n) {
+        m[i] = (i * seed + 7) % 101;
+        i++;
+    }
+    return m;
+}
+
+void multiply(int* a, int* b, int* c, int n) {
+    int i, j, k, sum;
+
+    i = 0;
+    while (i < n) {
+        j = 0;
+        while (j < n) {
+            sum = 0;
+            k = 0;
+            while (k < n) {
+                sum = sum + a[i * n + k] * b[k * n + j];
+                k++;
+            }
+            c[i * n + j] = sum;
+            j++;
+        }
+        i++;
+    }
+}
+
+int main() {
+    int *a, *b, *c, n, i, trace;
+
+    n = 160;
+    a = matrix(n, 3);
+    b = matrix(n, 5);
+    c = matrix(n, 1);
+    multiply(a, b, c, n);
+    trace = 0;
+    i = 0;
+    while (i < n) {
+        trace = trace + c[i * n + i];
+        i++;
+    }
+    printf("trace: %d\n", trace);
+    return 0;
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+# runs the guest programs in bench under the interpreter, as register code
+# (-r), under the jit and as native programs built by gcc, and prints for each
+# one the best wall time of $RUNS runs, the instructions the interpreter
+# executed in both forms, the instructions per second and the slowdown over
+# gcc
+
+CC=${CC:-./cc}
+RUNS=${RUNS:-3}
+TMP=${TMPDIR:-/tmp}/cc-bench.$$
+mkdir -p "$TMP" || exit 1
+trap 'rm -rf "$TMP"' EXIT
+
+# best_ms command...: the best wall time of the command in milliseconds
+best_ms() {
+    best=
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        start=$(date +%s%N)
+        "$@" > "$TMP/out" 2>&1 || { echo "failed: $*" >&2; cat "$TMP/out" >&2; exit 1; }
+        ms=$((($(date +%s%N) - start) / 1000000))
+        if [ -z "$best" ] || [ $ms -lt $best ]; then
+            best=$ms
+        fi
+        i=$((i + 1))
+    done
+    echo $best
+}
+
+# instructions cc_options...: the instructions the interpreter executed
+instructions() {
+    $CC -s "$@" | sed -n 's/^instructions(\(.*\))$/\1/p'
+}
+
+# report name instructions reg_instructions interp_ms reg_ms jit_ms native_ms
+report() {
+    awk -v name="$1" -v n="$2" -v rn="$3" -v t="$4" -v r="$5" -v j="$6" \
+        -v g="$7" 'BEGIN {
+        if (t < 1) t = 1
+        if (r < 1) r = 1
+        if (g < 1) g = 1
+        printf "%-8s %11d %11d %7d %7d %7d %7d %8.1f %7.1fx %6.1fx %6.1fx\n",
+               name, n, rn, t, r, j, g, n / t / 1000, t / g, r / g, j / g
+    }'
+}
+
+printf "%-8s %11s %11s %7s %7s %7s %7s %8s %8s %7s %7s\n" program \
+       instructions registers "interp" "-r" "jit" "gcc" "Minstr/s" \
+       "interp" "-r" "jit"
+printf "%-8s %11s %11s %7s %7s %7s %7s %8s %8s %7s %7s\n" "" "" "" \
+       "(ms)" "(ms)" "(ms)" "(ms)" "" "/gcc" "/gcc" "/gcc"
+
+for src in bench/*.c; do
+    name=$(basename "$src" .c)
+    gcc -O2 -w "$src" -o "$TMP/$name" || exit 1
+    n=$(instructions "$src")
+    rn=$(instructions -r "$src")
+    t=$(best_ms $CC "$src") || exit 1
+    r=$(best_ms $CC -r "$src") || exit 1
+    j=$(best_ms $CC -j "$src") || exit 1
+    g=$(best_ms "$TMP/$name") || exit 1
+    report "$name" "$n" "$rn" "$t" "$r" "$j" "$g"
+done
+
+# the compiler itself, compiling and running the tests, against the compiler
+# built by gcc doing the same
+n=$(instructions cc.c test.c)
+rn=$(instructions -r cc.c test.c)
+t=$(best_ms $CC cc.c test.c) || exit 1
+r=$(best_ms $CC -r cc.c test.c) || exit 1
+j=$(best_ms $CC -j cc.c test.c) || exit 1
+g=$(best_ms $CC test.c) || exit 1
+report cc "$n" "$rn" "$t" "$r" "$j" "$g"
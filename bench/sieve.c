@@ -0,0 +1,33 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// the sieve of Eratosthenes in a buffer from malloc, cleared with memset
+
+int main() {
+    char* flags;
+    int n, i, j, count, round;
+
+    n = 2000000;
+    flags = malloc(n + 1);
+    round = 0;
+    while (round < 5) {
+        memset(flags, 1, n + 1);
+        count = 0;
+        i = 2;
+        while (i <= n) {
+            if (flags[i]) {
+                count++;
+                j = i + i;
+                while (j <= n) {
+                    flags[j] = 0;
+                    j = j + i;
+                }
+            }
+            i++;
+        }
+        round++;
+    }
+    printf("primes below %d: %d\n", n, count);
+    return 0;
+}
@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+// pointer walks over a string: its length, its words and a checksum
+
+int length(char* s) {
+    char* p;
+
+    p = s;
+    while (*p) {
+        p++;
+    }
+    return p - s;
+}
+
+int words(char* s) {
+    int n, in_word;
+
+    n = 0;
+    in_word = 0;
+    while (*s) {
+        if (*s == ' ') {
+            in_word = 0;
+        } else if (!in_word) {
+            in_word = 1;
+            n++;
+        }
+        s++;
+    }
+    return n;
+}
+
+int checksum(char* s) {
+    int h;
+
+    h = 0;
+    while (*s) {
+        h = (h * 31 + *s++) % 65521;
+    }
+    return h;
+}
+
+int main() {
+    char *text, *p, *word;
+    int i, n, total;
+
+    n = 1000000;
+    text = malloc(n + 1);
+    p = text;
+    i = 0;
+    word = "lorem ipsum dolor sit amet ";
+    while (p < text + n) {
+        *p++ = word[i];
+        i = (i + 1) % 27;
+    }
+    *p = 0;
+
+    total = 0;
+    i = 0;
+    while (i < 10) {
+        total = (total + length(text) + words(text) + checksum(text)) % 65521;
+        i++;
+    }
+    printf("scan: %d\n", total);
+    return 0;
+}
@@ -1,33 +1,72 @@
+#include <dlfcn.h>
+#include <fcntl.h>
 #include <memory.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
-// #define int long long  // support 64 bit system
+// the word of the virtual machine is as wide as a pointer, so int is too.
+// when cc compiles itself the lines starting with # are skipped, and int is
+// the word of the cc which runs it.
+#define int intptr_t
+
+// call the native code of the JIT, the guest skips this line and has
+// jitcall as a builtin function instead (see JCAL)
+#define jitcall(code, argc, argv) ((int (*)(int, char**))(code))(argc, argv)
 
 // related to source code
 int token;            // current token
 int token_val;        // value of current token (mainly for number)
 char *src, *old_src;  // pointer to source code
-int poolsize;         // the default size of the data/text/stack
+char *src_buf,        // the buffer of a source read from a pipe
+    *src_end;         // its end while there is more to read (see refill)
+int src_fd;           // the pipe
+int poolsize;         // the size of the pools of symbols and case labels
 int line;             // line number
+int tokens;           // the number of calls of next, counted for -n
 
-// related to virtual machine stacks and segments
+// related to virtual machine stacks and segments, each one is reserved with
+// its limit (see reserve), which is set with -m
 int *text,      // text segment
     *old_text,  // for dump text segment
-    *stack;     // stack
+    *text_end;  // the end of the text segment, less a margin (see check_text)
 char* data;     // data segment
+char* data_end;  // the end of the data segment
+int text_size, data_size, stack_size;  // the limits, in bytes
+int huge;        // advise huge pages for the text segment and the stack
 
 // related to main function and debug
 int* idmain;  // the `main` function
 int debug;    // active debug model
-
-// related to virtual machine registers
-// bp: base pointer
-// sp: stack pointer
-// pc: program counter, points to the next instruction
-// ax: normal register, used for storing the calculated result
-int *pc, *bp, *sp, ax, cycle;
+int prof;     // profile the program (see profile)
+int stats;    // print the count of instructions the program executed
+int parse_only;  // stop after parsing and print its counts (see -n)
+int regs;     // run the register code (see to_registers)
+int *line_map,   // the line of each statement, as pairs of offset in text and
+    line_count;  // line, kept when profiling (see note_line)
+int opt;      // optimization level, 0 runs the code as it is parsed
+
+// related to the JIT (see jit_compile)
+int jit;          // run the program as native code instead of eval
+char* jit_code;   // the native code, mmap'd executable
+char* jit_pos;    // where the next byte of native code goes
+char* jit_exit;   // the end of the entry point, exit() jumps there
+int* jit_map;     // the native address of each word of the text segment
+int jit_base;     // the address the native code runs at
+int jit_got;      // the addresses of the library functions, by builtin
+int jit_uses;     // the builtins called by the program, one bit each
+char* output;     // write an executable instead of running (see write_elf)
+char* c_output;   // write C source instead of running (see write_c)
+char* bc_output;  // write bytecode instead of running (see write_bc)
+char* trace_path;  // write a binary trace while running (see trace_open)
+char* old_data;   // the start of the data segment
+
+// related to virtual machine, the registers are local variables of eval and
+// the rest of its state is in an instance (see cc_instance)
 
 // instructions, which is based on x86-64
 // more details can be found on eval function
@@ -38,9 +77,11 @@ enum {
     CALL,
     JZ,
     JNZ,
+    SWCH,
     ENT,
     ADJ,
     LEV,
+    TCALL,
     LI,
     LC,
     SI,
@@ -62,31 +103,140 @@ enum {
     MUL,
     DIV,
     MOD,
+    NEG,
+    // superinstructions, they are not emitted by the parser, but by the
+    // optimizer which fuses the common sequences (see optimize function)
+    LLI,
+    LLC,
+    LGI,
+    LGC,
+    SLI,
+    SLC,
+    SGI,
+    SGC,
+    ADDI,
+    SUBI,
+    MULI,
+    DIVI,
+    MODI,
+    SHLI,
+    SHRI,
+    ANDI,
+    EQI,
+    NEI,
+    LTI,
+    GTI,
+    LEI,
+    GEI,
+    EQJZ,
+    NEJZ,
+    LTJZ,
+    GTJZ,
+    LEJZ,
+    GEJZ,
+    // the top of the stack cached in the bx register, a PUSH is replaced by
+    // PSHB when the instruction which pops the value can use bx instead
+    PSHB,
+    ORB,
+    XORB,
+    ANDB,
+    EQB,
+    NEB,
+    LTB,
+    GTB,
+    LEB,
+    GEB,
+    SHLB,
+    SHRB,
+    ADDB,
+    SUBB,
+    MULB,
+    DIVB,
+    MODB,
+    SIB,
+    SCB,
+    // the data segment addressed from the data of an instance, the text of an
+    // image has these instead of absolute addresses (see cc_image)
+    IMD,
+    LDI,
+    LDC,
+    SDI,
+    SDC,
     OPEN,
     READ,
+    WRIT,
     CLOS,
     PRTF,
     MALC,
     MSET,
     MCMP,
-    EXIT
+    MMAP,
+    MADV,
+    LSEK,
+    FORK,
+    WAIT,
+    DSYM,
+    JCAL,
+    EXIT,
+    // the register code, only run by eval_reg: three operands from the frame
+    // for the operators, the immediate ones, the branches on a comparison of
+    // two registers or of a register and an immediate, and the moves (see
+    // to_registers)
+    ORR,
+    XORR,
+    ANDR,
+    EQR,
+    NER,
+    LTR,
+    GTR,
+    LER,
+    GER,
+    SHLR,
+    SHRR,
+    ADDR,
+    SUBR,
+    MULR,
+    DIVR,
+    MODR,
+    ADRI,
+    SBRI,
+    MLRI,
+    EQJR,
+    NEJR,
+    LTJR,
+    GTJR,
+    LEJR,
+    GEJR,
+    EQJI,
+    NEJI,
+    LTJI,
+    GTJI,
+    LEJI,
+    GEJI,
+    MOVR,
+    MOVI
 };
 
 // tokens and classes (operators last and in precedence order)
 enum {
     Num = 128,
     Fun,
+    Ext,
     Sys,
     Glo,
     Loc,
     Id,
+    Break,
+    Case,
     Char,
+    Default,
     Else,
     Enum,
     If,
     Int,
     Return,
     Sizeof,
+    Switch,
     While,
     Assign,
     Cond,
@@ -123,23 +273,49 @@ enum {
 //     int class;   // number, global or local variable
 //     int type;    // type, int, char or pointer
 //     int value;   // if is a function, it will store the address
-//     int Bclass;  // temperamentally storing the class of global variable
-//     int Btype;   // temperamentally storing the type of global variable
-//     int Bvalue;  // temperamentally storing the value of global variable
 // };
 
 // because not support struct, we use array to set up symbol table
 // Symbol table:
-// ----+-----+----+----+----+-----+-----+-----+------+------+----
-// .. |token|hash|name|type|class|value|btype|bclass|bvalue| ..
-// ----+-----+----+----+----+-----+-----+-----+------+------+----
-//     |<---       one single identifier                --->|
+// ----+-----+----+----+----+-----+-----+----
+// .. |token|hash|name|type|class|value| ..
+// ----+-----+----+----+----+-----+-----+----
+//     |<--- one single identifier --->|
+
+// the records are allocated from pools of `poolsize` bytes, a new pool is
+// allocated when the current one is full, so a record never moves once it is
+// created. they are found through a hash index (open addressing, linear
+// probing) which holds the address of each record, and the names are copied
+// into a string arena so that they no longer point into the source code.
 
 int *current_id,  // current parsed ID
-    *symbols;     // symbol table
+    *symbols,     // symbol table, the pool currently being filled
+    *sym_end,     // end of the current symbol pool
+    *sym_index;   // hash index, each slot is 0 or the address of a record
+int sym_mask;     // size of the hash index - 1, the size is a power of 2
+int sym_count;    // number of identifiers in the hash index
+char *names,      // string arena for the names of identifiers
+    *names_end;   // end of the current string arena
 
 // fields of identifier
-enum { Token, Hash, Name, Type, Class, Value, BType, BClass, BValue, IdSize };
+enum { Token, Hash, Name, Type, Class, Value, IdSize };
+
+// when a local variable shadows an identifier, the old class, type and value
+// are pushed onto the scope stack, and a scope starts with an entry whose
+// identifier is 0. leaving a scope only restores the entries above it, so it
+// costs the number of locals of that scope instead of the whole table.
+// Scope stack:
+// ----+---+---+---+---+---+-----+----+-----+----
+// .. | 0 | . | . | . |id |class|type|value| ..
+// ----+---+---+---+---+---+-----+----+-----+----
+//     |<- scope ->|   |<-  shadowed id  ->|
+
+int *scopes,     // scope stack
+    *scope_top,  // next free entry of the scope stack
+    *scope_end;  // end of the scope stack
+
+// fields of scope entry
+enum { ScopeId, ScopeClass, ScopeType, ScopeValue, ScopeSize };
 
 // types of variable/function
 enum { CHAR, INT, PTR };
@@ -149,11 +325,289 @@ int expr_type;  // the type of an expression
 
 int index_of_bp;  // index of bp pointer on stack
 
+// the last call of a function, for the tail calls (see tail_call)
+int *call_at,   // its CALL
+    *call_end;  // the end of its code
+int call_args;  // its count of arguments
+
+// the parser builds the tree of a function in the node arena, then
+// lower_statement emits its code, and lower the code of its expressions. a
+// node is its kind, three operands and the line it starts on, most kinds of
+// expression are the instruction which ends the code of the node:
+// IMM a (a constant, the address of a global or of a string), LEA a (the
+// address of a local), LI/LC a (load from a), OR to MOD a b, SI/SC a b (store
+// b at a), CALL id args n, and a system function args n.
+int *nodes,     // the node arena
+    *node_pos,  // the next free node
+    *node_end;  // end of the node arena
+
+// fields of node
+enum { NodeKind, NodeA, NodeB, NodeC, NodeLine, NodeSize };
+
+// the other kinds of node: a ? b : c, a || b, a && b, ++a and a++ (a is the
+// load of the variable, b the step, negative for --, and c the store), and
+// the list of the arguments of a call (a value and the next Arg)
+enum { Ternary = 1024, LogOr, LogAnd, PreInc, PostInc, Arg };
+
+// the kinds of statement: if (a) b else c, while (a) b (c is its count of
+// tokens), switch (a) b, case a:, default:, break;, return a; (a is 0
+// without a value), a; and { a } (a is a list of the statements, each one
+// is a StmtList of a statement and the next StmtList). an empty statement is
+// an empty block
+enum {
+    StmtIf = 1040,
+    StmtWhile,
+    StmtSwitch,
+    StmtCase,
+    StmtDefault,
+    StmtBreak,
+    StmtReturn,
+    StmtExpr,
+    StmtBlock,
+    StmtList
+};
+
+// the loops, for the loop optimizer (see hoist_invariants). a loop is the
+// code from the JMP which enters it to the end of its test, an unrolled loop
+// is followed by the loop of the iterations which are left (see
+// lower_statement)
+int *loops,      // the table of loops
+    loop_count,  // the count of loops
+    loop_max;    // the size of the table
+int addressed;   // the function takes the address of one of its variables
+int unrolling;   // the copies of a body being lowered are left out of line_map
+
+// fields of loop
+enum { LoopEntry, LoopEnd, LoopAddressed, LoopSize };
+
+// at -O2, the body of a counted loop which has at most UnrollTokens tokens
+// is copied Unroll times
+enum { Unroll = 4, UnrollTokens = 64 };
+
+// related to while and switch statements
+int *brks,       // pending `break` jumps, linked through their operands
+    *cases,      // (value, address) pairs of the case labels
+    *case_base,  // the first case label of the current switch, 0 if none
+    *case_top,   // next free pair of case labels
+    *case_end;   // end of the case labels
+int breakable;     // number of enclosing while and switch statements, and
+int switches;      // of switch statements, while parsing
+int case_default;  // address of the `default` label of the current switch
+
+// double the size of the hash index and insert all the identifiers again
+void grow_index() {
+    int *old_index, old_mask;
+    int i, j;
+
+    old_index = sym_index;
+    old_mask = sym_mask;
+    sym_mask = sym_mask * 2 + 1;
+    if (!(sym_index = malloc((sym_mask + 1) * sizeof(int)))) {
+        printf("could not malloc(%ld) for symbol index\n",
+               (sym_mask + 1) * sizeof(int));
+        exit(-1);
+    }
+    memset(sym_index, 0, (sym_mask + 1) * sizeof(int));
+
+    i = 0;
+    while (i <= old_mask) {
+        if (old_index[i]) {
+            j = ((int*)old_index[i])[Hash] & sym_mask;
+            while (sym_index[j]) {
+                j = (j + 1) & sym_mask;
+            }
+            sym_index[j] = old_index[i];
+        }
+        i++;
+    }
+}
+
+// create the record of a new identifier in slot `i` of the hash index, the
+// name is copied into the string arena
+int* new_id(int i, int hash, char* name, int len) {
+    int* id;
+
+    if (symbols + IdSize > sym_end) {
+        // the pool is full, the old records stay where they are
+        if (!(symbols = malloc(poolsize))) {
+            printf("could not malloc(%ld) for symbol table\n", poolsize);
+            exit(-1);
+        }
+        memset(symbols, 0, poolsize);
+        sym_end = symbols + poolsize / sizeof(int);
+    }
+    if (names + len + 1 > names_end) {
+        if (!(names = malloc(poolsize + len))) {
+            printf("could not malloc(%ld) for identifier names\n",
+                   poolsize + len);
+            exit(-1);
+        }
+        names_end = names + poolsize + len;
+    }
+
+    id = symbols;
+    symbols = symbols + IdSize;
+    id[Hash] = hash;
+    id[Name] = (int)names;
+    while (len > 0) {
+        *names++ = *name++;
+        len--;
+    }
+    *names++ = 0;
+
+    sym_index[i] = (int)id;
+    sym_count++;
+    return id;
+}
+
+// push an entry onto the scope stack, the stack is doubled when it is full
+void push_scope(int* id) {
+    int* old;
+    int size, i;
+
+    if (scope_top + ScopeSize > scope_end) {
+        old = scopes;
+        size = (scope_end - scopes) * 2;
+        if (!(scopes = malloc(size * sizeof(int)))) {
+            printf("could not malloc(%ld) for scope stack\n",
+                   size * sizeof(int));
+            exit(-1);
+        }
+        i = 0;
+        while (old + i < scope_top) {
+            scopes[i] = old[i];
+            i++;
+        }
+        scope_top = scopes + i;
+        scope_end = scopes + size;
+    }
+
+    scope_top[ScopeId] = (int)id;
+    if (id) {
+        scope_top[ScopeClass] = id[Class];
+        scope_top[ScopeType] = id[Type];
+        scope_top[ScopeValue] = id[Value];
+    }
+    scope_top = scope_top + ScopeSize;
+}
+
+// start a new scope, eg: the parameters and locals of a function
+void enter_scope() {
+    push_scope(0);
+}
+
+// declare a local variable in the current scope
+void declare_local(int* id, int type, int value) {
+    push_scope(id);
+    id[Class] = Loc;
+    id[Type] = type;
+    id[Value] = value;
+}
+
+// leave the current scope and recover the identifiers it shadowed
+void leave_scope() {
+    int* id;
+
+    while (1) {
+        scope_top = scope_top - ScopeSize;
+        if (!(id = (int*)scope_top[ScopeId])) {
+            return;
+        }
+        id[Class] = scope_top[ScopeClass];
+        id[Type] = scope_top[ScopeType];
+        id[Value] = scope_top[ScopeValue];
+    }
+}
+
+// reserve a segment of size bytes between two guard pages, at addr when it
+// is not 0. the pages are only committed when they are touched and they are
+// zero, so the limit of a segment can be large.
+char* reserve(int addr, int size) {
+    char* p;
+
+    size = (size + 4095) & -4096;
+    if (addr) {
+        // MAP_FIXED_NOREPLACE, it fails when the address is taken
+        p = (char*)mmap((char*)(addr - 4096), size + 8192, 0, 0x104022, -1, 0);
+        if ((int)p != addr - 4096) {
+            return 0;
+        }
+    } else {
+        // PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE
+        p = (char*)mmap(0, size + 8192, 0, 0x4022, -1, 0);
+        if ((int)p == -1) {
+            return 0;
+        }
+    }
+    // the segment between the guard pages is readable and writable
+    p = p + 4096;
+    if ((int)mmap(p, size, 3, 0x4032, -1, 0) != (int)p) {
+        return 0;
+    }
+    return p;
+}
+
+// stop when the data segment is full
+void check_data(int n) {
+    if (data + n > data_end) {
+        printf("%ld: data segment is full (-mdata=%ld)\n", line, data_size);
+        exit(-1);
+    }
+}
+
+// stop before the code overflows the text segment, n words are emitted. the
+// parser checks once for each expression and statement, whose own code is
+// much shorter than the margin of text_end.
+void check_text(int n) {
+    if (text + n > text_end) {
+        printf("%ld: text segment is full (-mtext=%ld)\n", line, text_size);
+        exit(-1);
+    }
+}
+
+// a source from a pipe or the standard input is read in chunks into src_buf.
+// when less than SrcMargin bytes are left, the rest moves to the start of the
+// buffer and the buffer is filled again, so a line must fit in the margin.
+enum { SrcChunk = 262144, SrcMargin = 65536 };
+
+void refill() {
+    char* p;
+    int n;
+
+    if (!src_end || src_end - src > SrcMargin) {
+        return;
+    }
+    p = src_buf;
+    while (src < src_end) {
+        *p++ = *src++;
+    }
+    src = src_buf;
+    n = 1;
+    while (p < src_buf + SrcChunk &&
+           (n = read(src_fd, p, src_buf + SrcChunk - p)) > 0) {
+        p = p + n;
+    }
+    if (n < 0) {
+        printf("%ld: read() returned %ld\n", line, n);
+        exit(-1);
+    }
+    *p = 0;  // add EOF character
+    src_end = p;
+    if (n == 0) {
+        close(src_fd);
+        src_end = 0;
+    }
+}
+
 // for lexical analysis, get the next token, it will automatically ignore
 // whitespace characters
 void next() {
     char* last_pos;
     int hash;
+    int i;
+
+    tokens++;
+    refill();
 
     while (token = *src) {
         ++src;
@@ -161,6 +615,7 @@ void next() {
         if (token == '\n') {
             // new line
             ++line;
+            refill();
         } else if (token == '#') {
             // skip macro, eg: # include <stdio.h>
             while (*src != 0 && *src != '\n') {
@@ -182,26 +637,32 @@ void next() {
                 src++;
             }
 
-            // looking for existing identifier from symbol table
-            current_id = symbols;
-            // this while loop is used to check all the existing token
-            while (current_id[Token]) {
-                // check the hash value and each char
+            // keep the hash index at most half full
+            if (sym_count * 2 >= sym_mask) {
+                grow_index();
+            }
+
+            // looking for existing identifier from the hash index, the probe
+            // stops at the first empty slot
+            i = hash & sym_mask;
+            while (current_id = (int*)sym_index[i]) {
+                // check the hash value and each char, the name in the arena
+                // must also end here
                 if (current_id[Hash] == hash &&
                     !memcmp((char*)current_id[Name], last_pos,
-                            src - last_pos)) {
+                            src - last_pos) &&
+                    !*((char*)current_id[Name] + (src - last_pos))) {
                     // found one, return
                     token = current_id[Token];
                     return;
                 }
-                // move to next identifier
-                current_id = current_id + IdSize;
+                // move to next slot
+                i = (i + 1) & sym_mask;
             }
 
             // store this new identifier
-            current_id[Name] = (int)last_pos;  // store the start pointer
-            current_id[Hash] = hash;           // store the hash value
-            token = current_id[Token] = Id;    // this is an identifier
+            current_id = new_id(i, hash, last_pos, src - last_pos);
+            token = current_id[Token] = Id;  // this is an identifier
 
             return;
         } else if (token >= '0' && token <= '9') {
@@ -251,6 +712,7 @@ void next() {
 
                 // store this string into data segment
                 if (token == '"') {
+                    check_data(1);
                     *data++ = token_val;
                 }
             }
@@ -381,27 +843,237 @@ void match(int tk) {
     if (token == tk) {
         next();
     } else {
-        printf("%d: expected token: %d\n", line, tk);
+        printf("%ld: expected token: %ld\n", line, tk);
         exit(-1);
     }
 }
 
-// for parsing an expression
-// todo need to double check
-void expression(int level) {
-    int* id;
+// a new node of the tree of a function
+int* node(int kind, int a, int b, int c) {
+    int* n;
+
+    if (node_pos + NodeSize > node_end) {
+        printf("%ld: function is too large\n", line);
+        exit(-1);
+    }
+    n = node_pos;
+    node_pos = node_pos + NodeSize;
+    n[NodeKind] = kind;
+    n[NodeA] = a;
+    n[NodeB] = b;
+    n[NodeC] = c;
+    n[NodeLine] = line;
+    return n;
+}
+
+// the lowest number, built from 2^(bits - 2) since its negation overflows
+int lowest() {
+    return -((int)1 << (sizeof(int) * 8 - 2)) * 2;
+}
+
+// a op b can be computed by the compiler: a division by zero, the quotient
+// of the lowest number by -1 and a shift by a negative count or by the
+// width of a number or more are left to the runtime, they trap or are
+// undefined on the host
+int foldable(int op, int a, int b) {
+    if (op == DIV || op == MOD) {
+        return b && (b != -1 || a != lowest());
+    }
+    if (op == SHL || op == SHR) {
+        return b >= 0 && b < sizeof(int) * 8;
+    }
+    return 1;
+}
+
+// the value of a op b, for OR to MOD
+int fold_op(int op, int a, int b) {
+    switch (op) {
+        case OR:
+            return a | b;
+        case XOR:
+            return a ^ b;
+        case AND:
+            return a & b;
+        case EQ:
+            return a == b;
+        case NE:
+            return a != b;
+        case LT:
+            return a < b;
+        case GT:
+            return a > b;
+        case LE:
+            return a <= b;
+        case GE:
+            return a >= b;
+        case SHL:
+            return a << b;
+        case SHR:
+            return a >> b;
+        case ADD:
+            return a + b;
+        case SUB:
+            return a - b;
+        case MUL:
+            return a * b;
+        case DIV:
+            return a / b;
+        default:
+            return a % b;
+    }
+}
+
+// k when v is 2^k and k > 0, otherwise 0
+int log2_of(int v) {
+    int k;
+
+    k = 1;
+    while (k < 62 && ((int)1 << k) != v) {
+        k++;
+    }
+    return (k < 62) ? k : 0;
+}
+
+// the node of a op b, for OR to MOD. it is folded when a and b are constants,
+// the unary operators use the same nodes (eg: `!x` is `x == 0`) so they are
+// folded too. an operand which does not change the other one is dropped, the
+// constants of `(x + a) + b` (also for - and *) are added together, and a
+// multiply by a power of two is a shift.
+int* binary(int op, int* a, int* b) {
+    int* c;
+    int k;
+
+    if (b[NodeKind] == IMM) {
+        if (a[NodeKind] == IMM) {
+            if (!foldable(op, a[NodeA], b[NodeA])) {
+                return node(op, (int)a, (int)b, 0);
+            }
+            return node(IMM, fold_op(op, a[NodeA], b[NodeA]), 0, 0);
+        }
+        if ((!b[NodeA] && (op == ADD || op == SUB || op == OR || op == XOR ||
+                           op == SHL || op == SHR)) ||
+            (b[NodeA] == 1 && (op == MUL || op == DIV))) {
+            return a;
+        }
+        c = (int*)a[NodeB];
+        if ((op == ADD || op == SUB || op == MUL) && a[NodeKind] == op &&
+            c[NodeKind] == IMM) {
+            b = node(IMM, op == MUL ? c[NodeA] * b[NodeA] : c[NodeA] + b[NodeA],
+                     0, 0);
+            return binary(op, (int*)a[NodeA], b);
+        }
+        if (op == MUL && (k = log2_of(b[NodeA]))) {
+            return node(SHL, (int)a, (int)node(IMM, k, 0, 0), 0);
+        }
+    } else if (a[NodeKind] == IMM) {
+        if ((!a[NodeA] && (op == ADD || op == OR || op == XOR)) ||
+            (a[NodeA] == 1 && op == MUL)) {
+            return b;
+        }
+        if (op == MUL && (k = log2_of(a[NodeA]))) {
+            return node(SHL, (int)b, (int)node(IMM, k, 0, 0), 0);
+        }
+    }
+    return node(op, (int)a, (int)b, 0);
+}
+
+// emit the code of the expression at n
+void lower(int* n) {
+    int *a, *b;
+    int k;
+
+    check_text(0);
+    k = n[NodeKind];
+    a = (int*)n[NodeA];
+    if (k == IMM || k == LEA) {
+        *++text = k;
+        *++text = n[NodeA];
+    } else if (k == LI || k == LC) {
+        lower(a);
+        *++text = k;
+    } else if ((k >= OR && k <= MOD) || k == SI || k == SC) {
+        lower(a);
+        *++text = PUSH;
+        lower((int*)n[NodeB]);
+        *++text = k;
+    } else if (k == Ternary) {
+        lower(a);
+        *++text = JZ;
+        b = ++text;
+        lower((int*)n[NodeB]);
+        *b = (int)(text + 3);
+        *++text = JMP;
+        b = ++text;
+        lower((int*)n[NodeC]);
+        *b = (int)(text + 1);
+    } else if (k == LogOr || k == LogAnd) {
+        lower(a);
+        *++text = (k == LogOr) ? JNZ : JZ;
+        b = ++text;
+        lower((int*)n[NodeB]);
+        *b = (int)(text + 1);
+    } else if (k == PreInc || k == PostInc) {
+        // the address is pushed for the store, then loaded
+        lower((int*)a[NodeA]);
+        *++text = PUSH;
+        *++text = a[NodeKind];
+        *++text = PUSH;
+        *++text = IMM;
+        *++text = (n[NodeB] < 0) ? -n[NodeB] : n[NodeB];
+        *++text = (n[NodeB] < 0) ? SUB : ADD;
+        *++text = n[NodeC];
+        if (k == PostInc) {
+            // the value before the increment
+            *++text = PUSH;
+            *++text = IMM;
+            *++text = (n[NodeB] < 0) ? -n[NodeB] : n[NodeB];
+            *++text = (n[NodeB] < 0) ? ADD : SUB;
+        }
+    } else {
+        // a call, the arguments are pushed in order
+        b = (int*)n[NodeB];
+        while (b) {
+            lower((int*)b[NodeA]);
+            *++text = PUSH;
+            b = (int*)b[NodeB];
+        }
+        if (k == CALL) {
+            *++text = CALL;
+            *++text = a[Value];
+            if (a[Class] == Ext) {
+                // a function which is only declared, its calls are chained
+                // through their operands until it is defined (see define)
+                a[Value] = (int)text;
+            }
+            call_at = text - 1;
+        } else {
+            *++text = k;  // system function
+        }
+
+        // clean the stack for arguments
+        if (n[NodeC] > 0) {
+            *++text = ADJ;
+            *++text = n[NodeC];
+        }
+        if (k == CALL) {
+            call_end = text;
+            call_args = n[NodeC];
+        }
+    }
+}
+
+// for parsing an expression, it returns its tree (see lower) and leaves its
+// type in expr_type
+int* expression(int level) {
+    int *n, *a, *id, *last;
     int tmp;
-    int* addr;
 
     if (token == Num) {
         match(Num);
-        // emit code
-        *++text = IMM;
-        *++text = token_val;
+        n = node(IMM, token_val, 0, 0);
         expr_type = INT;
     } else if (token == '"') {
-        *++text = IMM;
-        *++text = token_val;
+        n = node(IMM, token_val, 0, 0);
 
         match('"');  // start to store the string
         // use the following while loop to support multi line string
@@ -411,6 +1083,7 @@ void expression(int level) {
 
         // append the end of string character '\0', all the data are default
         // to 0, so just move data one position forward.
+        check_data(sizeof(int));
         data = (char*)(((int)data + sizeof(int)) & (-sizeof(int)));
         expr_type = PTR;
     } else if (token == Sizeof) {
@@ -435,9 +1108,7 @@ void expression(int level) {
 
         match(')');
 
-        // emit code
-        *++text = IMM;
-        *++text = (expr_type == Char) ? sizeof(char) : sizeof(int);
+        n = node(IMM, (expr_type == Char) ? sizeof(char) : sizeof(int), 0, 0);
 
         expr_type = INT;
     } else if (token == Id) {
@@ -454,11 +1125,17 @@ void expression(int level) {
             // function call
             match('(');
 
-            // pass the arguments
+            // the arguments, in a list
             tmp = 0;
+            a = last = 0;
             while (token != ')') {
-                expression(Assign);
-                *++text = PUSH;
+                n = node(Arg, (int)expression(Assign), 0, 0);
+                if (last) {
+                    last[NodeB] = (int)n;
+                } else {
+                    a = n;
+                }
+                last = n;
                 tmp++;
 
                 if (token == ',') {
@@ -468,48 +1145,34 @@ void expression(int level) {
 
             match(')');
 
-            // emit code
             if (id[Class] == Sys) {
                 // system function
-                *++text = id[Value];
-            } else if (id[Class] == Fun) {
-                // function call
-                *++text = CALL;
-                *++text = id[Value];
+                n = node(id[Value], 0, (int)a, tmp);
+            } else if (id[Class] == Fun || id[Class] == Ext) {
+                n = node(CALL, (int)id, (int)a, tmp);
             } else {
-                printf("%d: bad function call\n", line);
+                printf("%ld: bad function call\n", line);
                 exit(-1);
             }
-
-            // clean the stack for arguments
-            if (tmp > 0) {
-                *++text = ADJ;
-                *++text = tmp;
-            }
             expr_type = id[Type];
         } else if (id[Class] == Num) {
             // enum variable
-            *++text = IMM;
-            *++text = id[Value];
+            n = node(IMM, id[Value], 0, 0);
             expr_type = INT;
         } else {
             // variable
             if (id[Class] == Loc) {
-                *++text = LEA;
-                *++text = index_of_bp - id[Value];
+                n = node(LEA, index_of_bp - id[Value], 0, 0);
             } else if (id[Class] == Glo) {
-                *++text = IMM;
-                *++text = id[Value];
+                n = node(IMM, id[Value], 0, 0);
             } else {
-                printf("%d: undefined variable\n", line);
+                printf("%ld: undefined variable\n", line);
                 exit(-1);
             }
-
             //⑥
-            // emit code, default behaviour is to load the value of the
-            // address which is stored in `ax`
+            // default behaviour is to load the value of the address
             expr_type = id[Type];
-            *++text = (expr_type == Char) ? LC : LI;
+            n = node((expr_type == Char) ? LC : LI, (int)n, 0, 0);
         }
     }
     // ! follow the tutorial
@@ -526,67 +1189,58 @@ void expression(int level) {
 
             match(')');
 
-            expression(Inc);  // cast has precedence as Inc(++)
+            n = expression(Inc);  // cast has precedence as Inc(++)
 
             expr_type = tmp;
         } else {
             // normal parenthesis
-            expression(Assign);
+            n = expression(Assign);
             match(')');
         }
     } else if (token == Mul) {
         // dereference *<addr>
         match(Mul);
-        expression(Inc);  // dereference has the same precedence as Inc(++)
+        n = expression(Inc);  // dereference has the same precedence as Inc(++)
 
         if (expr_type >= PTR) {
             expr_type = expr_type - PTR;
         } else {
-            printf("%d: bad dereference\n", line);
+            printf("%ld: bad dereference\n", line);
             exit(-1);
         }
 
-        *++text = (expr_type == CHAR) ? LC : LI;
+        n = node((expr_type == CHAR) ? LC : LI, (int)n, 0, 0);
     } else if (token == And) {
         // get the address of
         match(And);
-        expression(Inc);  // get the address of
-        if (*text == LC || *text == LI) {
-            text--;
+        n = expression(Inc);  // get the address of
+        if (n[NodeKind] == LC || n[NodeKind] == LI) {
+            n = (int*)n[NodeA];
+            if (n[NodeKind] == LEA) {
+                addressed = 1;
+            }
         } else {
-            printf("%d: bad address of\n", line);
+            printf("%ld: bad address of\n", line);
             exit(-1);
         }
 
         expr_type = expr_type + PTR;
     } else if (token == '!') {
-        // not
+        // not, use <expr> == 0
         match('!');
-        expression(Inc);
-
-        // emit code, use <expr> == 0
-        *++text = PUSH;
-        *++text = IMM;
-        *++text = 0;
-        *++text = EQ;
+        n = binary(EQ, expression(Inc), node(IMM, 0, 0, 0));
 
         expr_type = INT;
     } else if (token == '~') {
-        // bitwise not
+        // bitwise not, use <expr> XOR -1
         match('~');
-        expression(Inc);
-
-        // emit code, use <expr> XOR -1
-        *++text = PUSH;
-        *++text = IMM;
-        *++text = -1;
-        *++text = XOR;
+        n = binary(XOR, expression(Inc), node(IMM, -1, 0, 0));
 
         expr_type = INT;
     } else if (token == Add) {
         // +var, do nothing
         match(Add);
-        expression(Inc);
+        n = expression(Inc);
 
         expr_type = INT;
     } else if (token == Sub) {
@@ -594,41 +1248,30 @@ void expression(int level) {
         match(Sub);
 
         if (token == Num) {
-            *++text = IMM;
-            *++text = -token_val;
+            n = node(IMM, -token_val, 0, 0);
             match(Num);
         } else {
-            *++text = IMM;
-            *++text = -1;
-            *++text = PUSH;
-            expression(Inc);
-            *++text = MUL;
+            a = node(IMM, -1, 0, 0);
+            n = binary(MUL, a, expression(Inc));
         }
 
         expr_type = INT;
     } else if (token == Inc || token == Dec) {
         tmp = token;
         match(token);
-        expression(Inc);
+        n = expression(Inc);
         // ①
-        if (*text == LC) {
-            *text = PUSH;  // to duplicate the address
-            *++text = LC;
-        } else if (*text == LI) {
-            *text = PUSH;
-            *++text = LI;
-        } else {
-            printf("%d: bad lvalue of pre-increment\n", line);
+        if (n[NodeKind] != LC && n[NodeKind] != LI) {
+            printf("%ld: bad lvalue of pre-increment\n", line);
             exit(-1);
         }
-        *++text = PUSH;
-        *++text = IMM;
         // ②
-        *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);
-        *++text = (tmp == Inc) ? ADD : SUB;
-        *++text = (expr_type == CHAR) ? SC : SI;
+        tmp = (tmp == Inc) ? 1 : -1;
+        n = node(PreInc, (int)n,
+                 tmp * ((expr_type > PTR) ? sizeof(int) : sizeof(char)),
+                 (expr_type == CHAR) ? SC : SI);
     } else {
-        printf("%d: bad expression\n", line);
+        printf("%ld: bad expression\n", line);
         exit(-1);
     }
 
@@ -641,239 +1284,201 @@ void expression(int level) {
             if (token == Assign) {
                 // var = expr;
                 match(Assign);
-                if (*text == LC || *text == LI) {
-                    *text = PUSH;  // save the lvalue's pointer
-                } else {
-                    printf("%d: bad lvalue in assignment\n", line);
+                if (n[NodeKind] != LC && n[NodeKind] != LI) {
+                    printf("%ld: bad lvalue in assignment\n", line);
                     exit(-1);
                 }
-                expression(Assign);
+                a = (int*)n[NodeA];  // the lvalue's pointer
+                n = node((tmp == CHAR) ? SC : SI, (int)a,
+                         (int)expression(Assign), 0);
 
                 expr_type = tmp;
-                *++text = (expr_type == CHAR) ? SC : SI;
             } else if (token == Cond) {
                 // expr ? a : b;
                 match(Cond);
-                *++text = JZ;
-                addr = ++text;
-                expression(Assign);
+                a = expression(Assign);
                 if (token == ':') {
                     match(':');
                 } else {
-                    printf("%d: missing colon in conditional\n", line);
+                    printf("%ld: missing colon in conditional\n", line);
                     exit(-1);
                 }
-                *addr = (int)(text + 3);
-                *++text = JMP;
-                addr = ++text;
-                expression(Cond);
-                *addr = (int)(text + 1);
+                if (n[NodeKind] == IMM) {
+                    // constant condition, only keep one branch
+                    if (n[NodeA]) {
+                        tmp = expr_type;
+                        expression(Cond);
+                        n = a;
+                        expr_type = tmp;
+                    } else {
+                        n = expression(Cond);
+                    }
+                } else {
+                    n = node(Ternary, (int)n, (int)a, (int)expression(Cond));
+                }
             } else if (token == Lor) {
                 // logic or
                 match(Lor);
-                *++text = JNZ;
-                addr = ++text;
-                expression(Lan);
-                *addr = (int)(text + 1);
+                a = expression(Lan);
+                if (n[NodeKind] == IMM) {
+                    // constant left side, a non-zero one is the result
+                    if (!n[NodeA]) {
+                        n = a;
+                    }
+                } else {
+                    n = node(LogOr, (int)n, (int)a, 0);
+                }
                 expr_type = INT;
             } else if (token == Lan) {
                 // logic and
                 match(Lan);
-                *++text = JZ;
-                addr = ++text;
-                expression(Or);
-                *addr = (int)(text + 1);
+                a = expression(Or);
+                if (n[NodeKind] == IMM) {
+                    // constant left side, a zero one is the result
+                    if (n[NodeA]) {
+                        n = a;
+                    }
+                } else {
+                    n = node(LogAnd, (int)n, (int)a, 0);
+                }
                 expr_type = INT;
             } else if (token == Or) {
                 // bitwise or
                 match(Or);
-                *++text = PUSH;
-                expression(Xor);
-                *++text = OR;
+                n = binary(OR, n, expression(Xor));
                 expr_type = INT;
             } else if (token == Xor) {
                 // bitwise xor
                 match(Xor);
-                *++text = PUSH;
-                expression(And);
-                *++text = XOR;
+                n = binary(XOR, n, expression(And));
                 expr_type = INT;
             } else if (token == And) {
                 // bitwise and
                 match(And);
-                *++text = PUSH;
-                expression(Eq);
-                *++text = AND;
+                n = binary(AND, n, expression(Eq));
                 expr_type = INT;
             } else if (token == Eq) {
                 // equal ==
                 match(Eq);
-                *++text = PUSH;
-                expression(Ne);
-                *++text = EQ;
+                n = binary(EQ, n, expression(Ne));
                 expr_type = INT;
             } else if (token == Ne) {
                 // not equal !=
                 match(Ne);
-                *++text = PUSH;
-                expression(Lt);
-                *++text = NE;
+                n = binary(NE, n, expression(Lt));
                 expr_type = INT;
             } else if (token == Lt) {
                 // less than
                 match(Lt);
-                *++text = PUSH;
-                expression(Shl);
-                *++text = LT;
+                n = binary(LT, n, expression(Shl));
                 expr_type = INT;
             } else if (token == Gt) {
                 // greater than
                 match(Gt);
-                *++text = PUSH;
-                expression(Shl);
-                *++text = GT;
+                n = binary(GT, n, expression(Shl));
                 expr_type = INT;
             } else if (token == Le) {
                 // less than or equal to
                 match(Le);
-                *++text = PUSH;
-                expression(Shl);
-                *++text = LE;
+                n = binary(LE, n, expression(Shl));
                 expr_type = INT;
             } else if (token == Ge) {
                 // greater than or equal to
                 match(Ge);
-                *++text = PUSH;
-                expression(Shl);
-                *++text = GE;
+                n = binary(GE, n, expression(Shl));
                 expr_type = INT;
             } else if (token == Shl) {
                 // shift left
                 match(Shl);
-                *++text = PUSH;
-                expression(Add);
-                *++text = SHL;
+                n = binary(SHL, n, expression(Add));
                 expr_type = INT;
             } else if (token == Shr) {
                 // shift right
                 match(Shr);
-                *++text = PUSH;
-                expression(Add);
-                *++text = SHR;
+                n = binary(SHR, n, expression(Add));
                 expr_type = INT;
             } else if (token == Add) {
                 // add
                 match(Add);
-                *++text = PUSH;
-                expression(Mul);
+                a = expression(Mul);
 
                 expr_type = tmp;
                 if (expr_type > PTR) {
                     // pointer type, and not `char *`
-                    *++text = PUSH;
-                    *++text = IMM;
-                    *++text = sizeof(int);
-                    *++text = MUL;
+                    a = binary(MUL, a, node(IMM, sizeof(int), 0, 0));
                 }
-                *++text = ADD;
+                n = binary(ADD, n, a);
             } else if (token == Sub) {
                 // sub
                 match(Sub);
-                *++text = PUSH;
-                expression(Mul);
+                a = expression(Mul);
                 if (tmp > PTR && tmp == expr_type) {
-                    // pointer subtraction
-                    *++text = SUB;
-                    *++text = PUSH;
-                    *++text = IMM;
-                    *++text = sizeof(int);
-                    *++text = DIV;
+                    // pointer subtraction, the difference is a multiple of
+                    // the size so the division is a shift
+                    n = binary(SHR, binary(SUB, n, a),
+                               node(IMM, log2_of(sizeof(int)), 0, 0));
                     expr_type = INT;
                 } else if (tmp > PTR) {
                     // pointer movement
-                    *++text = PUSH;
-                    *++text = IMM;
-                    *++text = sizeof(int);
-                    *++text = MUL;
-                    *++text = SUB;
+                    a = binary(MUL, a, node(IMM, sizeof(int), 0, 0));
+                    n = binary(SUB, n, a);
                     expr_type = tmp;
                 } else {
                     // numeral subtraction
-                    *++text = SUB;
+                    n = binary(SUB, n, a);
                     expr_type = tmp;
                 }
             } else if (token == Mul) {
                 // multiply
                 match(Mul);
-                *++text = PUSH;
-                expression(Inc);
-                *++text = MUL;
+                n = binary(MUL, n, expression(Inc));
                 expr_type = tmp;
             } else if (token == Div) {
                 // divide
                 match(Div);
-                *++text = PUSH;
-                expression(Inc);
-                *++text = DIV;
+                n = binary(DIV, n, expression(Inc));
                 expr_type = tmp;
             } else if (token == Mod) {
                 // Modulo
                 match(Mod);
-                *++text = PUSH;
-                expression(Inc);
-                *++text = MOD;
+                n = binary(MOD, n, expression(Inc));
                 expr_type = tmp;
             } else if (token == Inc || token == Dec) {
                 // postfix inc(++) and dec(--)
                 // we will increase the value to the variable and decrease it
                 // on `ax` to get its original value.
-                if (*text == LI) {
-                    *text = PUSH;
-                    *++text = LI;
-                } else if (*text == LC) {
-                    *text = PUSH;
-                    *++text = LC;
-                } else {
-                    printf("%d: bad value in increment\n", line);
+                if (n[NodeKind] != LI && n[NodeKind] != LC) {
+                    printf("%ld: bad value in increment\n", line);
                     exit(-1);
                 }
-
-                *++text = PUSH;
-                *++text = IMM;
-                *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);
-                *++text = (token == Inc) ? ADD : SUB;
-                *++text = (expr_type == CHAR) ? SC : SI;
-                *++text = PUSH;
-                *++text = IMM;
-                *++text = (expr_type > PTR) ? sizeof(int) : sizeof(char);
-                *++text = (token == Inc) ? SUB : ADD;
+                tmp = (token == Inc) ? 1 : -1;
+                n = node(PostInc, (int)n,
+                         tmp * ((expr_type > PTR) ? sizeof(int) : sizeof(char)),
+                         (expr_type == CHAR) ? SC : SI);
                 match(token);
             } else if (token == Brak) {
                 // array access var[xx]
                 match(Brak);
-                *++text = PUSH;
-                expression(Assign);
+                a = expression(Assign);
                 match(']');
 
                 if (tmp > PTR) {
                     // pointer, `not char *`
-                    *++text = PUSH;
-                    *++text = IMM;
-                    *++text = sizeof(int);
-                    *++text = MUL;
+                    a = binary(MUL, a, node(IMM, sizeof(int), 0, 0));
                 } else if (tmp < PTR) {
-                    printf("%d: pointer type expected\n", line);
+                    printf("%ld: pointer type expected\n", line);
                     exit(-1);
                 }
                 expr_type = tmp - PTR;
-                *++text = ADD;
-                *++text = (expr_type == CHAR) ? LC : LI;
+                n = node((expr_type == CHAR) ? LC : LI, (int)binary(ADD, n, a),
+                         0, 0);
             } else {
-                printf("%d: compiler error, token = %d\n", line, token);
+                printf("%ld: compiler error, token = %ld\n", line, token);
                 exit(-1);
             }
         }
     }
+    return n;
 }
 
 void function_parameter() {
@@ -899,24 +1504,19 @@ void function_parameter() {
 
         // parameter name
         if (token != Id) {
-            printf("%d: bad parameter declaration\n", line);
+            printf("%ld: bad parameter declaration\n", line);
             exit(-1);
         }
         // declarated the local variable
         if (current_id[Class] == Loc) {
-            printf("%d: duplicate parameter declaration\n", line);
+            printf("%ld: duplicate parameter declaration\n", line);
             exit(-1);
         }
 
         match(Id);
 
         // store the local variable
-        current_id[BClass] = current_id[Class];
-        current_id[Class] = Loc;
-        current_id[BType] = current_id[Type];
-        current_id[Type] = type;
-        current_id[BValue] = current_id[Value];
-        current_id[Value] = params++;  // index of current parameter
+        declare_local(current_id, type, params++);  // index of parameter
 
         if (token == ',') {
             match(',');
@@ -927,90 +1527,682 @@ void function_parameter() {
     index_of_bp = params + 1;
 }
 
-// used to handle statement
-void statement() {
-    // only have following six kinds of statement for us
-    // 1. if (...) <statement> [else <statement>]
-    // 2. while (...) <statement>
-    // 3. { <statement> }
-    // 4. return xxx;
-    // 5. <empty statement>;
-    // 6. expression; (expression end with semicolon)
-
-    int *a, *b;  // bess for branch control
-
-    if (token == If) {
-        // if (...) <statement> [else <statement>]
-        match(If);
-        match('(');
-        expression(Assign);  // parse condition
-        match(')');
-
-        *++text = JZ;
-        b = ++text;
+// resolve the pending `break` jumps to the next instruction, and restore the
+// chain of the enclosing while or switch statement
+void resolve_breaks(int* outer) {
+    int* p;
 
-        statement();  // parse statement
-        if (token == Else) {
-            match(Else);
-            // jmp b
-            *b = (int)(text + 3);
-            *++text = JMP;
-            b = ++text;
+    while (brks) {
+        p = (int*)*brks;
+        *brks = (int)(text + 1);
+        brks = p;
+    }
+    brks = outer;
+}
 
-            statement();
+// emit the compare chain of a switch statement whose case labels are too
+// sparse for a jump table, the labels are sorted and each one subtracts the
+// distance to the previous value from ax: PUSH, IMM <distance>, SUB, JZ
+// <case address>, then a jump to the default
+void switch_chain() {
+    int *p, *q;
+    int v, a, last;
+
+    p = case_base + 2;
+    while (p < case_top) {
+        v = p[0];
+        a = p[1];
+        q = p;
+        while (q > case_base && q[-2] > v) {
+            q[0] = q[-2];
+            q[1] = q[-1];
+            q = q - 2;
         }
+        q[0] = v;
+        q[1] = a;
+        p = p + 2;
+    }
 
-        *b = (int)(text + 1);
-    } else if (token == While) {
-        // while (...) <statement>
-        match(While);
-        a = text + 1;
-        match('(');
-        expression(Assign);
-        match(')');
-
+    check_text((case_top - case_base) * 3 + 2);
+    last = 0;
+    p = case_base;
+    while (p < case_top) {
+        if (p > case_base && p[0] == last) {
+            printf("%ld: duplicate case value %ld\n", line, p[0]);
+            exit(-1);
+        }
+        *++text = PUSH;
+        *++text = IMM;
+        *++text = p[0] - last;
+        *++text = SUB;
         *++text = JZ;
-        b = ++text;
-
-        statement();
+        *++text = p[1];
+        last = p[0];
+        p = p + 2;
+    }
+    *++text = JMP;
+    text++;
+    *text = case_default ? case_default : (int)(text + 1);
+}
 
-        *++text = JMP;
-        *++text = (int)a;
-        *b = (int)(text + 1);
-    } else if (token == Return) {
-        // return xxx;
-        match(Return);
+// emit the jump table of a switch statement from its case labels
+// SWCH <lowest value> <number of entries> <default address> <entries>...
+void switch_table() {
+    int *p, *table;
+    int lo, hi, n;
 
-        if (token != ';') {
-            expression(Assign);
+    lo = hi = 0;
+    if (case_top > case_base) {
+        lo = hi = case_base[0];
+    }
+    p = case_base;
+    while (p < case_top) {
+        if (p[0] < lo) {
+            lo = p[0];
         }
+        if (p[0] > hi) {
+            hi = p[0];
+        }
+        p = p + 2;
+    }
 
-        match(';');
+    n = (case_top > case_base) ? hi - lo + 1 : 0;
+    if (n > (case_top - case_base) * 2 + 64) {
+        switch_chain();
+        return;
+    }
 
-        // emit code for return
-        *++text = LEV;
-    } else if (token == '{') {
-        // { <statement> ... }
-        match('{');
+    check_text(n + 4);
+    *++text = SWCH;
+    *++text = lo;
+    *++text = n;
+    *++text = case_default;
+    table = text + 1;
+    text = text + n;
+    if (!case_default) {
+        // no default label, leave the switch
+        table[-1] = (int)(text + 1);
+    }
 
-        while (token != '}') {
-            statement();
+    p = table;
+    while (p <= text) {
+        *p++ = 0;
+    }
+    p = case_base;
+    while (p < case_top) {
+        if (table[p[0] - lo]) {
+            printf("%ld: duplicate case value %ld\n", line, p[0]);
+            exit(-1);
         }
+        table[p[0] - lo] = p[1];
+        p = p + 2;
+    }
+    p = table;
+    while (p <= text) {
+        if (!*p) {
+            *p = table[-1];
+        }
+        p++;
+    }
+}
 
-        match('}');
-    } else if (token == ';') {
-        // empty statement
-        match(';');
-    } else {
-        // a = b; or function_call();
-        expression(Assign);
-        match(';');
+// number of operands of an instruction, the entries of a jump table are not
+// counted
+int op_args(int op) {
+    if (op == SWCH) {
+        return 3;
+    }
+    if (op == TCALL) {
+        return 2;
     }
+    if (op <= ADJ || (op >= LLI && op <= GEI) || (op >= IMD && op <= SDC)) {
+        return 1;
+    }
+    if (op >= EQJZ && op <= GEJZ) {
+        return 2;
+    }
+    if (op >= ORR && op <= GEJI) {
+        return 3;
+    }
+    if (op == MOVR || op == MOVI) {
+        return 2;
+    }
+    return 0;
 }
 
-void function_body() {
-    // body_decl ::= {variable_decl}, {statement}
-    // type func_name (...) {...}
+// the instruction after the one at p
+int* next_op(int* p) {
+    if (*p == SWCH) {
+        return p + 4 + p[2];
+    }
+    return p + 1 + op_args(*p);
+}
+
+// an address in the data segment
+int is_data(int v) {
+    return v >= (int)old_data && v <= (int)data;
+}
+
+// the operand of the instruction at p which may hold an address in the data
+// segment (see bc_image and cc_image), 0 when it has none
+int* data_operand(int* p) {
+    if (*p == JMP || *p == JZ || *p == JNZ || *p == CALL || *p == TCALL ||
+        *p == SWCH || !op_args(*p)) {
+        return 0;
+    }
+    return p + 1;
+}
+
+// find the instruction which pops the value pushed by the PUSH at p. this is
+// only used inside of expressions, which never jump backward, so the search
+// gives up (returns 0) as soon as it leaves the expression.
+int* pop_of(int* p) {
+    int depth;
+
+    depth = 1;
+    p = p + 1;
+    while (1) {
+        if (*p == PUSH) {
+            depth++;
+        } else if ((*p >= OR && *p <= MOD) || *p == SI || *p == SC) {
+            if (!--depth) {
+                return p;
+            }
+        } else if (*p == ADJ) {
+            // arguments of a function call
+            depth = depth - p[1];
+            if (depth <= 0) {
+                return 0;
+            }
+        } else if (*p == JMP || *p == JZ || *p == JNZ) {
+            if ((int*)p[1] <= p) {
+                return 0;
+            }
+        } else if (*p == LEV || *p == TCALL || *p == ENT || *p == SWCH) {
+            return 0;
+        }
+        p = next_op(p);
+    }
+}
+
+// `return f(...);` ends with the call at call_at, it becomes TCALL f n when f
+// takes no more arguments than the function itself (see TCALL). the code of
+// the return statement starts after start, its jumps to the end of the call
+// go to the end of TCALL, which is a word shorter (longer without arguments)
+void tail_call(int* start) {
+    int* p;
+
+    p = start + 1;
+    while (p < call_at) {
+        if ((*p == JMP || *p == JZ || *p == JNZ) && (int*)p[1] == text + 1) {
+            p[1] = (int)(call_at + 3);
+        }
+        p = next_op(p);
+    }
+    *call_at = TCALL;
+    call_at[2] = call_args;
+    text = call_at + 2;
+}
+
+// emit the test at the bottom of a loop, which jumps back to top while the
+// condition n holds. a comparison is inverted to end with JZ, which fuse_ops
+// turns into a compare and branch
+void lower_loop_test(int* n, int* top) {
+    int k;
+
+    k = n[NodeKind];
+    if (k >= EQ && k <= GE) {
+        if (k == EQ) {
+            k = NE;
+        } else if (k == NE) {
+            k = EQ;
+        } else if (k == LT) {
+            k = GE;
+        } else if (k == GE) {
+            k = LT;
+        } else if (k == GT) {
+            k = LE;
+        } else {
+            k = GT;
+        }
+        lower(node(k, n[NodeA], n[NodeB], 0));
+        *++text = JZ;
+    } else {
+        lower(n);
+        *++text = JNZ;
+    }
+    *++text = (int)top;
+}
+
+// the loop entered by the JMP at entry ends at the next instruction
+void add_loop(int* entry) {
+    int* l;
+
+    if (loop_count < loop_max) {
+        l = loops + loop_count * LoopSize;
+        l[LoopEntry] = (int)entry;
+        l[LoopEnd] = (int)(text + 1);
+        l[LoopAddressed] = addressed;
+        loop_count++;
+    }
+}
+
+// the start of the code which adds 1 to local k at the end of the code, for
+// `k++`, `++k` or `k = k + 1`, or 0
+int* increment(int k) {
+    int* p;
+
+    p = text - 12;
+    if (p[0] == LEA && p[1] == k && p[2] == PUSH && p[3] == LI &&
+        p[4] == PUSH && p[5] == IMM && p[6] == 1 && p[7] == ADD &&
+        p[8] == SI && p[9] == PUSH && p[10] == IMM && p[11] == 1 &&
+        p[12] == SUB) {
+        return p;
+    }
+    p = text - 8;
+    if (p[0] == LEA && p[1] == k && p[2] == PUSH && p[3] == LI &&
+        p[4] == PUSH && p[5] == IMM && p[6] == 1 && p[7] == ADD &&
+        p[8] == SI) {
+        return p;
+    }
+    p = text - 10;
+    if (p[0] == LEA && p[1] == k && p[2] == PUSH && p[3] == LEA &&
+        p[4] == k && p[5] == LI && p[6] == PUSH && p[7] == IMM && p[8] == 1 &&
+        p[9] == ADD && p[10] == SI) {
+        return p;
+    }
+    return 0;
+}
+
+// check that the loop with the condition n, whose body is the code from top
+// to text, is counted: n is `i < m` or `i <= m` for a local i and a constant
+// or a local m, the body always ends with the increment of i, it stores to i
+// nowhere else and never to m. no local of the function has its address
+// taken, it could change through a pointer
+int counted_loop(int* n, int* top) {
+    int *i, *m, *inc, *p, *last, *c, *q;
+    int stores, found;
+
+    i = (int*)n[NodeA];
+    m = (int*)n[NodeB];
+    if ((n[NodeKind] != LT && n[NodeKind] != LE) || addressed ||
+        i[NodeKind] != LI || ((int*)i[NodeA])[NodeKind] != LEA) {
+        return 0;
+    }
+    i = (int*)i[NodeA];
+    if (m[NodeKind] == LI && ((int*)m[NodeA])[NodeKind] == LEA) {
+        m = (int*)m[NodeA];
+        if (m[NodeA] == i[NodeA]) {
+            return 0;
+        }
+    } else if (m[NodeKind] != IMM) {
+        return 0;
+    }
+    if (text - top < 12 || !(inc = increment(i[NodeA]))) {
+        return 0;
+    }
+
+    // the stores and the jumps of the body
+    stores = found = 0;
+    last = 0;
+    p = top;
+    while (p <= text) {
+        if (p == inc) {
+            found = 1;
+        }
+        if (*p == PUSH && last && *last == LEA && (c = pop_of(p)) &&
+            (*c == SI || *c == SC)) {
+            if (last[1] == i[NodeA]) {
+                stores++;
+            } else if (m[NodeKind] == LEA && last[1] == m[NodeA]) {
+                return 0;
+            }
+        } else if ((*p == JMP || *p == JZ || *p == JNZ) &&
+                   (int*)p[1] > inc && (int*)p[1] <= text + 1) {
+            return 0;
+        } else if (*p == SWCH) {
+            q = p + 3;
+            while (q < p + 4 + p[2]) {
+                if ((int*)*q > inc && (int*)*q <= text + 1) {
+                    return 0;
+                }
+                q++;
+            }
+        }
+        last = p;
+        p = next_op(p);
+    }
+    return found && stores == 1;
+}
+
+// the statement which starts at the next instruction is on the current line,
+// a statement which starts at the same offset is inside the one before
+void note_line() {
+    int* p;
+
+    p = line_map + line_count * 2 - 2;
+    if (line_count && *p == text + 1 - old_text) {
+        p[1] = line;
+        return;
+    }
+    p = p + 2;
+    p[0] = text + 1 - old_text;
+    p[1] = line;
+    line_count++;
+}
+
+// parse a statement into its tree (see lower_statement)
+int* statement() {
+    // only have following kinds of statement for us
+    // 1. if (...) <statement> [else <statement>]
+    // 2. while (...) <statement>
+    // 3. { <statement> }
+    // 4. return xxx;
+    // 5. <empty statement>;
+    // 6. expression; (expression end with semicolon)
+    // 7. switch (...) <statement>
+    // 8. case <constant>: and default:
+    // 9. break;
+
+    int *n, *a, *last;
+    int value;
+
+    n = node(StmtBlock, 0, 0, 0);
+    if (token == If) {
+        // if (...) <statement> [else <statement>]
+        match(If);
+        match('(');
+        n[NodeKind] = StmtIf;
+        n[NodeA] = (int)expression(Assign);  // parse condition
+        match(')');
+
+        n[NodeB] = (int)statement();  // parse statement
+        if (token == Else) {
+            match(Else);
+            n[NodeC] = (int)statement();
+        }
+    } else if (token == While) {
+        // while (...) <statement>
+        match(While);
+        match('(');
+        n[NodeKind] = StmtWhile;
+        n[NodeA] = (int)expression(Assign);
+        match(')');
+
+        breakable++;
+        value = tokens;
+        n[NodeB] = (int)statement();
+        n[NodeC] = tokens - value;
+        breakable--;
+    } else if (token == Switch) {
+        // switch (...) <statement>
+        match(Switch);
+        match('(');
+        n[NodeKind] = StmtSwitch;
+        n[NodeA] = (int)expression(Assign);
+        match(')');
+
+        breakable++;
+        switches++;
+        n[NodeB] = (int)statement();
+        switches--;
+        breakable--;
+    } else if (token == Case) {
+        // case <constant>:
+        match(Case);
+        if (!switches) {
+            printf("%ld: case outside of switch\n", line);
+            exit(-1);
+        }
+
+        value = 1;
+        if (token == Sub) {
+            match(Sub);
+            value = -1;
+        }
+        if (token == Num) {
+            value = value * token_val;
+        } else if (token == Id && current_id[Class] == Num) {
+            // enum variable
+            value = value * current_id[Value];
+        } else {
+            printf("%ld: bad case value\n", line);
+            exit(-1);
+        }
+        next();
+        match(':');
+        n[NodeKind] = StmtCase;
+        n[NodeA] = value;
+    } else if (token == Default) {
+        // default:
+        match(Default);
+        match(':');
+        if (!switches) {
+            printf("%ld: default outside of switch\n", line);
+            exit(-1);
+        }
+        n[NodeKind] = StmtDefault;
+    } else if (token == Break) {
+        // break;
+        match(Break);
+        match(';');
+        if (!breakable) {
+            printf("%ld: break outside of while or switch\n", line);
+            exit(-1);
+        }
+        n[NodeKind] = StmtBreak;
+    } else if (token == Return) {
+        // return xxx;
+        match(Return);
+        n[NodeKind] = StmtReturn;
+        if (token != ';') {
+            n[NodeA] = (int)expression(Assign);
+        }
+        match(';');
+    } else if (token == '{') {
+        // { <statement> ... }
+        match('{');
+
+        last = 0;
+        while (token != '}') {
+            a = node(StmtList, (int)statement(), 0, 0);
+            if (last) {
+                last[NodeB] = (int)a;
+            } else {
+                n[NodeA] = (int)a;
+            }
+            last = a;
+        }
+
+        match('}');
+    } else if (token == ';') {
+        // empty statement
+        match(';');
+    } else {
+        // a = b; or function_call();
+        n[NodeKind] = StmtExpr;
+        a = expression(Assign);
+        if (a[NodeKind] == PostInc) {
+            a[NodeKind] = PreInc;  // the value before is not used
+        }
+        n[NodeA] = (int)a;
+        match(';');
+    }
+    return n;
+}
+
+// emit the code of the statement at n, line is set to the line of the
+// statement for the errors and for line_map
+void lower_statement(int* n) {
+    int *a, *b, *c, *body;
+    int *old_brks, *old_base, *old_cases, old_default;
+    int k, i;
+
+    check_text(0);
+    line = n[NodeLine];
+    if (line_map && !unrolling) {
+        note_line();
+    }
+    k = n[NodeKind];
+    c = (int*)n[NodeA];
+    body = (int*)n[NodeB];
+    if (k == StmtIf) {
+        b = 0;
+        if (c[NodeKind] != IMM) {
+            lower(c);
+            *++text = JZ;
+            b = ++text;
+        } else if (!c[NodeA]) {
+            // constant false condition, jump over the dead statement, which
+            // the peephole optimizer removes
+            *++text = JMP;
+            b = ++text;
+        }
+
+        lower_statement(body);
+        if (n[NodeC]) {
+            // jmp b
+            a = b;
+            *++text = JMP;
+            b = ++text;
+            if (a) {
+                *a = (int)(text + 1);
+            }
+
+            lower_statement((int*)n[NodeC]);
+        }
+
+        if (b) {
+            *b = (int)(text + 1);
+        }
+    } else if (k == StmtWhile) {
+        // the condition is tested at the bottom, so that an iteration only
+        // runs one branch: `JMP b; a: <statement>; b: <condition>; JNZ a`
+        old_brks = brks;
+        old_cases = case_top;
+        old_default = case_default;
+        brks = 0;
+        *++text = JMP;
+        b = ++text;
+        a = text + 1;
+        lower_statement(body);
+
+        if (c[NodeKind] == IMM && !c[NodeA]) {
+            // constant false condition, jump over the dead statement, which
+            // the peephole optimizer removes
+            *b = (int)(text + 1);
+        } else if (c[NodeKind] == IMM) {
+            *b = (int)a;
+            *++text = JMP;
+            *++text = (int)a;
+            add_loop(b - 1);
+        } else {
+            if (opt > 1 && !brks && case_top == old_cases &&
+                case_default == old_default && n[NodeC] <= UnrollTokens &&
+                loop_count + 2 <= loop_max && counted_loop(c, a)) {
+                // unroll a counted loop: Unroll copies of the body while
+                // `i + Unroll - 1 < m`, then the loop of the iterations which
+                // are left. the copies count for the line of the loop
+                line = n[NodeLine];
+                if (line_map && !unrolling) {
+                    note_line();
+                }
+                unrolling++;
+                i = 1;
+                while (i < Unroll) {
+                    lower_statement(body);
+                    i++;
+                }
+                *b = (int)(text + 1);
+                lower_loop_test(
+                    node(c[NodeKind],
+                         (int)binary(ADD, (int*)c[NodeA],
+                                     node(IMM, Unroll - 1, 0, 0)),
+                         c[NodeB], 0),
+                    a);
+                add_loop(b - 1);
+
+                *++text = JMP;
+                b = ++text;
+                a = text + 1;
+                lower_statement(body);
+                unrolling--;
+            }
+            *b = (int)(text + 1);
+            lower_loop_test(c, a);
+            add_loop(b - 1);
+        }
+        resolve_breaks(old_brks);
+    } else if (k == StmtSwitch) {
+        lower(c);
+
+        // jump over the body to the jump table
+        *++text = JMP;
+        b = ++text;
+
+        old_brks = brks;
+        old_base = case_base;
+        old_default = case_default;
+        brks = 0;
+        case_base = case_top;
+        case_default = 0;
+        lower_statement(body);
+
+        // the end of the body leaves the switch like a `break`
+        *++text = JMP;
+        *++text = (int)brks;
+        brks = text;
+
+        *b = (int)(text + 1);
+        switch_table();
+
+        case_top = case_base;
+        case_base = old_base;
+        case_default = old_default;
+        resolve_breaks(old_brks);
+    } else if (k == StmtCase) {
+        if (case_top + 2 > case_end) {
+            printf("%ld: too many case labels\n", line);
+            exit(-1);
+        }
+        case_top[0] = (int)c;
+        case_top[1] = (int)(text + 1);
+        case_top = case_top + 2;
+    } else if (k == StmtDefault) {
+        case_default = (int)(text + 1);
+    } else if (k == StmtBreak) {
+        *++text = JMP;
+        *++text = (int)brks;
+        brks = text;
+    } else if (k == StmtReturn) {
+        a = text;
+        call_end = 0;
+        if (c) {
+            lower(c);
+        }
+
+        // a call which is the whole value, with at most as many arguments
+        // as the function has, reuses its frame. not when the function
+        // takes the address of a local, which the callee may still use
+        if (call_end == text && call_args < index_of_bp && !addressed) {
+            tail_call(a);
+        }
+
+        // emit code for return
+        *++text = LEV;
+    } else if (k == StmtBlock) {
+        while (c) {
+            lower_statement((int*)c[NodeA]);
+            c = (int*)c[NodeB];
+        }
+    } else {
+        lower(c);
+    }
+}
+
+void function_body() {
+    // body_decl ::= {variable_decl}, {statement}
+    // type func_name (...) {...}
     //                   -->|   |<--
 
     // ... {
@@ -1019,8 +2211,11 @@ void function_body() {
     // }
 
     int pos_local;  // position of local variables on the stack.
-    int type;
+    int type, l;
+    int *body, *a, *last;
     pos_local = index_of_bp;  // new base pointer
+    node_pos = nodes;
+    addressed = 0;
 
     while (token == Int || token == Char) {
         // local variable declaration
@@ -1036,23 +2231,18 @@ void function_body() {
 
             if (token != Id) {
                 // invalid declaration
-                printf("%d: bad local declaration\n", line);
+                printf("%ld: bad local declaration\n", line);
                 exit(-1);
             }
             if (current_id[Class] == Loc) {
                 // identifier exists
-                printf("%d: duplicate local declaration\n", line);
+                printf("%ld: duplicate local declaration\n", line);
                 exit(-1);
             }
             match(Id);
 
             // store the local variable
-            current_id[BClass] = current_id[Class];
-            current_id[Class] = Loc;
-            current_id[BType] = current_id[Type];
-            current_id[Type] = type;
-            current_id[BValue] = current_id[Value];
-            current_id[Value] = ++pos_local;  // index of current parameter
+            declare_local(current_id, type, ++pos_local);  // index of local
 
             if (token == ',') {
                 match(',');
@@ -1064,45 +2254,76 @@ void function_body() {
     // rext is the memory address of function, which is in
     // code segment (also used in global declaration)
 
+    // statements, the function is parsed before its code is emitted
+    body = node(StmtBlock, 0, 0, 0);
+    last = 0;
+    while (token != '}') {
+        a = node(StmtList, (int)statement(), 0, 0);
+        if (last) {
+            last[NodeB] = (int)a;
+        } else {
+            body[NodeA] = (int)a;
+        }
+        last = a;
+    }
+
     *++text = ENT;                      // start the function body
     *++text = pos_local - index_of_bp;  // local variable size
 
-    // statements
-    while (token != '}') {
-        statement();
-    }
+    l = line;  // the line of the end of the function, for the parser
+    lower_statement(body);
+    line = l;
 
     // emit code for leaving the sub function
     *++text = LEV;
 }
 
-void function_declaration() {
-    // function_decl ::= type {'*'} id '(' parameter_decl ')' '{' body_decl '}'
+// the function id starts at the next instruction, the calls which were
+// chained while it was only declared get its address
+void define(int* id) {
+    int *p, *next;
+
+    p = (int*)id[Value];
+    while (p) {
+        next = (int*)*p;
+        *p = (int)(text + 1);
+        p = next;
+    }
+    id[Class] = Fun;
+    id[Value] = (int)(text + 1);
+}
+
+void function_declaration(int* id) {
+    // function_decl ::= type {'*'} id '(' parameter_decl ')'
+    //                   ('{' body_decl '}' | ';')
     // type func_name (...) {...}
     //               | this part
 
+    enter_scope();
     match('(');
     function_parameter();
     match(')');
 
+    if (token == ';') {
+        // only a declaration, the function is defined later or in another
+        // translation unit
+        leave_scope();
+        return;
+    }
+    if (id[Class] == Fun) {
+        printf("%ld: duplicate function definition\n", line);
+        exit(-1);
+    }
+    define(id);
     match('{');
     function_body();
     // not match the final }, while leave the while loop in global declartion to
     // handle it
     // match('}');
 
-    // unwind local variable declarations for all local variables.
-    current_id = symbols;
-    // need to do this operation for all the global value
-    while (current_id[Token]) {
-        if (current_id[Class] == Loc) {
-            // recover the global value
-            current_id[Class] = current_id[BClass];
-            current_id[Type] = current_id[BType];
-            current_id[Value] = current_id[BValue];
-        }
-        current_id = current_id + IdSize;
-    }
+    // unwind local variable declarations, only the identifiers shadowed by
+    // this function are recovered
+    leave_scope();
 }
 
 void enum_declaration() {
@@ -1111,7 +2332,7 @@ void enum_declaration() {
     i = 0;
     while (token != '}') {
         if (token != Id) {
-            printf("%d: bad enum identifier %d\n", line, token);
+            printf("%ld: bad enum identifier %ld\n", line, token);
             exit(-1);
         }
         next();
@@ -1119,7 +2340,7 @@ void enum_declaration() {
             // like {a=10}
             next();
             if (token != Num) {
-                printf("%d: bad enum initializer\n", line);
+                printf("%ld: bad enum initializer\n", line);
                 exit(-1);
             }
             i = token_val;
@@ -1141,10 +2362,11 @@ void global_declaration() {
     // global_declaration ::= enum_decl | variable_decl | function_decl
     // enum_decl ::= 'enum' [id] '{' id ['=' 'num'] {',' id ['=' 'num'} '}'
     // variable_decl ::= type {'*'} id { ',' {'*'} id } ';'
-    // function_decl ::= type {'*'} id '(' parameter_decl ')' '{' body_decl '}'
+    // function_decl ::= type {'*'} id '(' parameter_decl ')'
+    //                   ('{' body_decl '}' | ';')
 
     int type;  // temp, actual type for variable
-    int i;     // temp
+    int* id;   // the declared identifier
 
     basetype = INT;
 
@@ -1186,33 +2408,41 @@ void global_declaration() {
 
         if (token != Id) {
             // invalid
-            printf("%d: bad global declaration\n", line);
+            printf("%ld: bad global declaration\n", line);
             exit(-1);
         }
 
         // this current_id will be changed by next function
         // it will automatically move to next identifier space or the existing
         // identifier in symbol table
-        if (current_id[Class]) {
+        id = current_id;
+        match(Id);
+        if (token == '(' && (id[Class] == Fun || id[Class] == Ext)) {
+            // declared before, it must be the same function
+            if (id[Type] != type) {
+                printf("%ld: conflicting types for function\n", line);
+                exit(-1);
+            }
+        } else if (id[Class]) {
             // identifier exists
-            printf("%d: duplicate global declaration\n", line);
+            printf("%ld: duplicate global declaration\n", line);
             exit(-1);
         }
-
-        match(Id);
-        current_id[Type] = type;
+        id[Type] = type;
 
         if (token == '(') {
-            // find the matching (, this is a function
-            current_id[Class] = Fun;
-            current_id[Value] =
-                (int)(text + 1);  // the memory address of function, which is in
-                                  // code segment
-            function_declaration();
+            // find the matching (, this is a function. it is only declared
+            // until its body, which is in the code segment
+            if (!id[Class]) {
+                id[Class] = Ext;
+                id[Value] = 0;
+            }
+            function_declaration(id);
         } else {
             // variable declaration
-            current_id[Class] = Glo;        // global variable
-            current_id[Value] = (int)data;  // assign memory address
+            id[Class] = Glo;        // global variable
+            check_data(sizeof(int));
+            id[Value] = (int)data;  // assign memory address
             data = data + sizeof(int);
         }
 
@@ -1231,196 +2461,4484 @@ void program() {
     }
 }
 
-// the entry point of the virtual machine, used to interpret the object code
-int eval() {
-    int op, *tmp;
-    cycle = 0;
-    while (1) {
-        cycle++;
-        op = *pc++;  // get next operation code
+// the optimizer rewrites the text segment after the whole program is parsed
+// and before it is run. each pass compacts the code in place, the new code
+// is never longer than the old one. a sequence is only fused when nothing
+// jumps into the middle of it, and the jumps are moved to the new addresses
+// at the end of each pass.
+int *labels,  // 1 if the instruction at the same offset is a jump target
+    *moved,   // new address of the instruction at the same offset
+    *marks;   // the rewrite planned for the instruction at the same offset
+
+// mark the jump targets of the text segment, the entry of a function is
+// also a target even if it is never called (eg: main). main is only a
+// number when the program was loaded from bytecode (see load_bc)
+void find_labels() {
+    int *p, *q, *id;
+    int i;
 
-        // print debug info
-        if (debug) {
-            printf("%d> %.4s", cycle,
-                   & "LEA ,IMM ,JMP ,CALL,JZ  ,JNZ ,ENT ,ADJ ,LEV ,LI  ,LC  ,SI  ,SC  ,PUSH,"
-                   "OR  ,XOR ,AND ,EQ  ,NE  ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
-                   "OPEN,READ,CLOS,PRTF,MALC,MSET,MCMP,EXIT"[op * 5]);
-            if (op <= ADJ)
-                printf(" %d\n", *pc);
-            else
-                printf("\n");
-        }
-
-        if (op == IMM) {
-            ax = *pc++;  // load immediate value to ax
-        } else if (op == LC) {
-            ax = *(char*)ax;  // load character to ax, address in ax
-        } else if (op == LI) {
-            ax = *(int*)ax;  // load int to ax, address in ax
-        } else if (op == SC) {
-            // save character to address, value in ax, address on stack
-            // sp++ is equal to stack pop
-            ax = *(char*)* sp++ = ax;
-        } else if (op == SI) {
-            // save integer to address, value in ax, address on stack
-            *(int*)*sp++ = ax;
-        } else if (op == PUSH) {
-            *--sp = ax;  // push the current value into the stack
-        } else if (op == JMP) {
-            // pc is used to store the position of next instruction
-            // jump to the next instruction
-            pc = (int*)*pc;
-        } else if (op == JZ) {
-            // jump if ax is equal to zero
-            pc = ax ? pc + 1 : (int*)*pc;
-        } else if (op == JNZ) {
-            // jump if ax is not equal to zero
-            pc = ax ? (int*)*pc : pc + 1;
-        } else if (op == CALL) {
-            *--sp = (int)(pc + 1);  // store following address into stack
-            pc = (int*)*pc;         // call subroutine to function address
-        }
-        // return from subroutine, replaced by LEV
-        // else if (op == REF) {
-        //     pc = (int*)*sp++;
-        // }
-        else if (op == ENT) {
-            // make new call frame
-            *--sp = (int)bp;  // store the current base pointer
-            bp = sp;          // base pointer will be the current stack pointer
-            sp = sp - *pc++;  // set some place for local variable
-        } else if (op == ADJ) {
-            // remove argument from frame
-            sp = sp + *pc++;
-        } else if (op == LEV) {
-            // restore call frame and PC
-            // no need additional REF instruction
-            sp = bp;           // reset the sp
-            bp = (int*)*sp++;  // recover the bp from stack
-            pc = (int*)*sp++;  // ?? where is the pc info come from
-        } else if (op == LEA) {
-            // load address for the arguments
-            ax = (int)(bp + *pc++);
-        }
-        // operator instruction set, from c4
-        // The first parameter is placed at the top of the stack, and the second
-        // parameter is placed in ax
-        else if (op == OR) {
-            ax = *sp++ | ax;
-        } else if (op == XOR) {
-            ax = *sp++ ^ ax;
-        } else if (op == AND) {
-            ax = *sp++ & ax;
-        } else if (op == EQ) {
-            ax = *sp++ == ax;
-        } else if (op == NE) {
-            ax = *sp++ != ax;
-        } else if (op == LT) {
-            ax = *sp++ < ax;
-        } else if (op == LE) {
-            ax = *sp++ <= ax;
-        } else if (op == GT) {
-            ax = *sp++ > ax;
-        } else if (op == GE) {
-            ax = *sp++ >= ax;
-        } else if (op == SHL) {
-            ax = *sp++ << ax;
-        } else if (op == SHR) {
-            ax = *sp++ >> ax;
-        } else if (op == ADD) {
-            ax = *sp++ + ax;
-        } else if (op == SUB) {
-            ax = *sp++ - ax;
-        } else if (op == MUL) {
-            ax = *sp++ * ax;
-        } else if (op == DIV) {
-            ax = *sp++ / ax;
-        } else if (op == MOD) {
-            ax = *sp++ % ax;
-        }
-        // some build in function
-        else if (op == EXIT) {
-            printf("exit(%d)\n", *sp);
-            return *sp;
-        } else if (op == OPEN) {
-            ax = open((char*)sp[1], sp[0]);
-        } else if (op == CLOS) {
-            ax = close(*sp);
-        } else if (op == READ) {
-            ax = read(sp[2], (char*)sp[1], *sp);
-        } else if (op == PRTF) {
-            tmp = sp + pc[1];
-            ax = printf((char*)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5],
-                        tmp[-6]);
-        } else if (op == MALC) {
-            ax = (int)malloc(*sp);
-        } else if (op == MSET) {
-            ax = (int)memset((char*)sp[2], sp[1], *sp);
-        } else if (op == MCMP) {
-            ax = memcmp((char*)sp[2], (char*)sp[1], *sp);
-        } else {
-            printf("unknown instruction:%d\n", op);
-            return -1;
+    memset(labels, 0, (text - old_text + 2) * sizeof(int));
+    i = 0;
+    while (i <= sym_mask) {
+        id = (int*)sym_index[i];
+        if (id && (id[Class] == Fun || (id == idmain && id[Value]))) {
+            labels[(int*)id[Value] - old_text] = 1;
         }
+        i++;
     }
-    return 0;
-}
 
-// the main function
-int main(int argc, char** argv) {
-    int i, fd;
-    int* tmp;
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == JMP || *p == JZ || *p == JNZ || *p == CALL ||
+            *p == TCALL) {
+            labels[(int*)p[1] - old_text] = 1;
+        } else if (*p >= EQJZ && *p <= GEJZ) {
+            labels[(int*)p[2] - old_text] = 1;
+        } else if (*p >= EQJR && *p <= GEJI) {
+            labels[(int*)p[3] - old_text] = 1;
+        } else if (*p == SWCH) {
+            q = p + 3;
+            while (q < p + 4 + p[2]) {
+                labels[(int*)*q - old_text] = 1;
+                q++;
+            }
+        }
+        p = next_op(p);
+    }
+}
 
-    argc--;
-    argv++;
+// the pass has written the new code up to `end`, move the jumps and the
+// functions to the new addresses of their targets
+void relocate(int* end) {
+    int *p, *q, *id;
+    int i;
 
-    poolsize = 256 * 1024;
-    line = 1;
+    moved[text - old_text + 1] = (int)(end + 1);
+    text = end;
 
-    // allocate memory for initializing the virtual machine
-    if (!(text = old_text = malloc(poolsize))) {
-        printf("could not malloc(%d) for text segment area\n", poolsize);
-        return -1;
-    }
-    if (!(data = malloc(poolsize))) {
-        printf("could not malloc(%d) for data segment area\n", poolsize);
-        return -1;
-    }
-    if (!(stack = malloc(poolsize))) {
-        printf("could not malloc(%d) for stack segment area\n", poolsize);
-        return -1;
+    i = 0;
+    while (i < line_count) {
+        line_map[i * 2] = (int*)moved[line_map[i * 2]] - old_text;
+        i++;
     }
-    if (!(symbols = malloc(poolsize))) {
-        printf("could not malloc(%d) for symbol table\n", poolsize);
-        return -1;
+
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == JMP || *p == JZ || *p == JNZ || *p == CALL ||
+            *p == TCALL) {
+            p[1] = moved[(int*)p[1] - old_text];
+        } else if (*p >= EQJZ && *p <= GEJZ) {
+            p[2] = moved[(int*)p[2] - old_text];
+        } else if (*p >= EQJR && *p <= GEJI) {
+            p[3] = moved[(int*)p[3] - old_text];
+        } else if (*p == SWCH) {
+            q = p + 3;
+            while (q < p + 4 + p[2]) {
+                *q = moved[(int*)*q - old_text];
+                q++;
+            }
+        }
+        p = next_op(p);
     }
 
-    memset(text, 0, poolsize);
-    memset(data, 0, poolsize);
-    memset(stack, 0, poolsize);
-    memset(symbols, 0, poolsize);
+    i = 0;
+    while (i <= sym_mask) {
+        id = (int*)sym_index[i];
+        if (id && (id[Class] == Fun || (id == idmain && id[Value]))) {
+            id[Value] = moved[(int*)id[Value] - old_text];
+        }
+        i++;
+    }
+}
 
-    // initialize the registers
-    // the stack starts from high address to low address
-    // bp and sp will start from the highest address
-    bp = sp = (int*)((int)stack + poolsize);
-    ax = 0;
+// check that the instruction sets ax without reading it first
+int loads_ax(int op) {
+    return op == IMM || op == LEA || op == CALL || op == LLI || op == LLC ||
+           op == LGI || op == LGC;
+}
 
-    // init the keyword in symbol table
-    src =
-        "char else enum if int return sizeof while "
-        "open read close printf malloc memset memcmp exit void main";
+// `LEA n; PUSH; <value>; SI` and `IMM a; PUSH; <value>; SI` store to an
+// address known before the value is computed, so the address does not need
+// to go through the stack: `<value>; SLI n` and `<value>; SGI a`.
+void fuse_stores() {
+    int *p, *q, *n, *last, *c;
+
+    find_labels();
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+
+    // plan the rewrites
+    last = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == PUSH && last && (*last == LEA || *last == IMM) &&
+            !labels[p - old_text] && (c = pop_of(p)) &&
+            (*c == SI || *c == SC)) {
+            if (*last == LEA) {
+                marks[c - old_text] = (*c == SI) ? SLI : SLC;
+            } else {
+                marks[c - old_text] = (*c == SI) ? SGI : SGC;
+            }
+            moved[c - old_text] = last[1];  // the operand of the new store
+            marks[p - old_text] = -1;       // drop the PUSH
+            if (loads_ax(p[1])) {
+                // the value does not use the address left in ax
+                marks[last - old_text] = -1;
+            }
+        }
+        last = p;
+        p = next_op(p);
+    }
 
-    // add keywords to symbol table
-    i = Char;
-    while (i <= While) {
-        next();
-        current_id[Token] = i++;
+    // rewrite
+    p = old_text + 1;
+    q = old_text;
+    while (p <= text) {
+        n = next_op(p);
+        if (marks[p - old_text] == -1) {
+            moved[p - old_text] = (int)(q + 1);
+        } else if (marks[p - old_text]) {
+            *++q = marks[p - old_text];
+            *++q = moved[p - old_text];
+            moved[p - old_text] = (int)(q - 1);
+        } else {
+            moved[p - old_text] = (int)(q + 1);
+            while (p < n) {
+                *++q = *p++;
+            }
+        }
+        p = n;
     }
+    relocate(q);
+}
 
-    // add library to symbol table
-    i = OPEN;
-    while (i <= EXIT) {
+// fuse the loads of variables, the operators with an immediate operand and
+// the comparisons followed by a branch:
+// `LEA n; LI` -> `LLI n`, `IMM a; LI` -> `LGI a`,
+// `PUSH; IMM k; ADD` -> `ADDI k`, `PUSH; IMM k; LT; JZ a` -> `LTJZ k a`.
+// a division or a modulo is only fused for a positive k, which cannot trap
+// and which the native code turns into shifts or a multiply (see emit_div)
+void fuse_ops() {
+    int *p, *q, *n, *p2, *p3;
+    int op, k;
+
+    find_labels();
+    p = old_text + 1;
+    q = old_text;
+    while (p <= text) {
+        moved[p - old_text] = (int)(q + 1);
+        op = *p;
+        n = next_op(p);
+        p2 = n;
+        p3 = p2 + 2;
+        if ((op == LEA || op == IMM) && p2 <= text &&
+            (*p2 == LI || *p2 == LC) && !labels[p2 - old_text]) {
+            // load a local or global variable
+            k = p[1];
+            if (op == LEA) {
+                *++q = (*p2 == LI) ? LLI : LLC;
+            } else {
+                *++q = (*p2 == LI) ? LGI : LGC;
+            }
+            *++q = k;
+            n = p2 + 1;
+        } else if (op == PUSH && p3 <= text && *p2 == IMM &&
+                   !labels[p2 - old_text] && !labels[p3 - old_text] &&
+                   !is_data(p2[1]) &&
+                   ((*p3 >= ADD && *p3 <= MUL) || (*p3 >= EQ && *p3 <= GE) ||
+                    *p3 == SHL || *p3 == SHR || *p3 == AND ||
+                    ((*p3 == DIV || *p3 == MOD) && p2[1] > 0))) {
+            // operator with an immediate operand. an address in the data
+            // segment stays in IMM, which cc_image makes relative to the
+            // data of the instance
+            k = p2[1];
+            n = p3 + 1;
+            if (*p3 >= EQ && *p3 <= GE && n <= text && *n == JZ &&
+                !labels[n - old_text]) {
+                // comparison followed by a branch
+                *++q = EQJZ + (*p3 - EQ);
+                *++q = k;
+                *++q = n[1];
+                n = n + 2;
+            } else {
+                if (*p3 >= ADD) {
+                    *++q = ADDI + (*p3 - ADD);
+                } else if (*p3 == SHL) {
+                    *++q = SHLI;
+                } else if (*p3 == SHR) {
+                    *++q = SHRI;
+                } else if (*p3 == AND) {
+                    *++q = ANDI;
+                } else {
+                    *++q = EQI + (*p3 - EQ);
+                }
+                *++q = k;
+            }
+        } else {
+            while (p < n) {
+                *++q = *p++;
+            }
+        }
+        p = n;
+    }
+    relocate(q);
+}
+
+// the final target of a jump, following the jumps to unconditional jumps
+int* jump_target(int* p) {
+    int hops;
+
+    hops = 0;
+    while (*p == JMP && hops < 16) {
+        p = (int*)p[1];
+        hops++;
+    }
+    return p;
+}
+
+// fold `IMM a; ADDI b` and the other operators with an immediate operand
+int fold_imm(int op, int a, int b) {
+    if (op == ADDI) {
+        return a + b;
+    } else if (op == SUBI) {
+        return a - b;
+    } else if (op == MULI) {
+        return a * b;
+    } else if (op == DIVI) {
+        return a / b;
+    } else if (op == MODI) {
+        return a % b;
+    } else if (op == SHLI) {
+        return a << b;
+    } else if (op == SHRI) {
+        return a >> b;
+    } else if (op == ANDI) {
+        return a & b;
+    } else if (op == EQI) {
+        return a == b;
+    } else if (op == NEI) {
+        return a != b;
+    } else if (op == LTI) {
+        return a < b;
+    } else if (op == GTI) {
+        return a > b;
+    } else if (op == LEI) {
+        return a <= b;
+    }
+    return a >= b;
+}
+
+// remove the obvious waste left by the one pass code generation:
+// - jumps to unconditional jumps go to the final target, and a JMP to the
+//   next instruction is removed
+// - the code after LEV, TCALL or JMP is removed until the next jump target,
+//   eg: the LEV at the end of a function which already returned
+// - `IMM -1; PUSH; <x>; MUL` for negation becomes `<x>; NEG`
+// - `IMM a; ADDI b` becomes `IMM a+b`, also for the other immediate operators
+// - `SLI n; LLI n` becomes `SLI n`, the stored value is still in ax
+void peephole() {
+    int *p, *q, *n, *c, *last;
+
+    // jump threading, in place
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == JMP || *p == JZ || *p == JNZ) {
+            p[1] = (int)jump_target((int*)p[1]);
+        } else if (*p >= EQJZ && *p <= GEJZ) {
+            p[2] = (int)jump_target((int*)p[2]);
+        } else if (*p == SWCH) {
+            q = p + 3;
+            while (q < p + 4 + p[2]) {
+                *q = (int)jump_target((int*)*q);
+                q++;
+            }
+        }
+        p = next_op(p);
+    }
+
+    // plan the negations
+    find_labels();
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+    last = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == PUSH && last && *last == IMM && last[1] == -1 &&
+            !labels[p - old_text] && loads_ax(p[1]) &&
+            (c = pop_of(p)) && *c == MUL) {
+            marks[last - old_text] = -1;
+            marks[p - old_text] = -1;
+            marks[c - old_text] = NEG;
+        }
+        last = p;
+        p = next_op(p);
+    }
+
+    // rewrite
+    p = old_text + 1;
+    q = old_text;
+    last = 0;  // the last instruction written
+    while (p <= text) {
+        moved[p - old_text] = (int)(q + 1);
+        n = next_op(p);
+        if (last && (*last == LEV || *last == JMP || *last == TCALL) &&
+            !labels[p - old_text]) {
+            // unreachable
+        } else if (*p == JMP && (int*)p[1] == n) {
+            // jump to the next instruction
+        } else if (marks[p - old_text] == -1) {
+            // dropped by the negation, the operand which follows may sit
+            // at the place of a label, so it must not look unreachable
+            last = 0;
+        } else if (marks[p - old_text] == NEG) {
+            last = q + 1;
+            *++q = NEG;
+        } else if (last && *last == IMM && !labels[p - old_text] &&
+                   *p >= ADDI && *p <= GEI &&
+                   ((*p != SHLI && *p != SHRI) ||
+                    foldable(SHL, last[1], p[1]))) {
+            // fold into the previous immediate
+            last[1] = fold_imm(*p, last[1], p[1]);
+        } else if (last && !labels[p - old_text] &&
+                   ((*last == SLI && *p == LLI) || (*last == SLC && *p == LLC) ||
+                    (*last == SGI && *p == LGI) || (*last == SGC && *p == LGC)) &&
+                   last[1] == p[1]) {
+            // reload of the value which was just stored
+        } else {
+            last = q + 1;
+            while (p < n) {
+                *++q = *p++;
+            }
+        }
+        p = n;
+    }
+    relocate(q);
+}
+
+// check that nothing between the PUSH at p and the instruction at c which
+// pops the value needs the value on the stack or uses the bx register
+int cacheable(int* p, int* c) {
+    p = next_op(p);
+    while (p < c) {
+        if (*p == PUSH || *p == CALL || *p == TCALL || *p == ADJ ||
+            *p == ENT || *p == LEV || *p == SWCH || *p >= PSHB) {
+            return 0;
+        }
+        p = next_op(p);
+    }
+    return 1;
+}
+
+// keep the top of the stack in the bx register: a PUSH whose value is popped
+// before anything else is pushed, called or read from the stack becomes
+// PSHB, and the instruction which pops it takes the value from bx. this
+// happens in place, the instructions keep their sizes.
+void cache_pushes() {
+    int *p, *c;
+
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == PUSH && (c = pop_of(p)) && cacheable(p, c)) {
+            *p = PSHB;
+            if (*c == SI) {
+                *c = SIB;
+            } else if (*c == SC) {
+                *c = SCB;
+            } else {
+                *c = ORB + (*c - OR);
+            }
+        }
+        p = next_op(p);
+    }
+}
+
+// allocate the arrays of the passes, they are shared by the backends
+void alloc_passes() {
+    int size;
+
+    if (labels) {
+        return;
+    }
+    size = (text - old_text + 2) * sizeof(int);
+    if (!(labels = malloc(size)) || !(moved = malloc(size)) ||
+        !(marks = malloc(size))) {
+        printf("could not malloc(%ld) for optimizer\n", size);
+        exit(-1);
+    }
+}
+
+// the loop optimizer moves the invariant parts of the expressions of a loop
+// before it: a span of code which computes a value from constants and from
+// variables the loop never stores to is computed once into a new local of
+// the function, and the loop loads that local instead. a span only loads
+// variables and has no division, so it is safe to compute it even when the
+// loop runs no iteration. it is moved when it has an operator or loads a
+// global, the load of a local costs as much as the one of the new local.
+// unlike the other passes the code grows, it is rewritten into a buffer.
+enum { SpanStart, SpanEnd, SpanSlot, SpanLoop, SpanSize };  // fields of span
+
+// check that loop l may change the variable loaded by `LEA k; LI` or
+// `IMM a; LI` (or LC) at v. marks has the address of each store, the
+// instruction which computed it when it is a local or a global, or -1
+int loop_stores(int* l, int* v) {
+    int *p, *a;
+    int w;
+
+    w = (v[2] == LC) ? sizeof(char) : sizeof(int);
+    p = (int*)l[LoopEntry];
+    while (p < (int*)l[LoopEnd]) {
+        if (*p == CALL || *p == TCALL || (*p >= OPEN && *p <= EXIT)) {
+            // a function may store to the globals and through the pointers
+            if (*v == IMM || l[LoopAddressed]) {
+                return 1;
+            }
+        } else if (*p == SI || *p == SC) {
+            a = (int*)marks[p - old_text];
+            if (a == (int*)-1) {
+                // through a pointer
+                if (*v == IMM || l[LoopAddressed]) {
+                    return 1;
+                }
+            } else if (*a == LEA && *v == LEA) {
+                if (a[1] == v[1]) {
+                    return 1;
+                }
+            } else if (*a == IMM && *v == IMM && a[1] < v[1] + w &&
+                       v[1] < a[1] + ((*p == SC) ? sizeof(char) : sizeof(int))) {
+                return 1;
+            }
+        }
+        p = next_op(p);
+    }
+    return 0;
+}
+
+// the end of the longest span from p which is worth moving out of loop l,
+// or 0
+int* invariant_span(int* p, int* l) {
+    int *start, *end, *n;
+    int depth, worth;
+
+    start = p;
+    end = 0;
+    depth = worth = 0;
+    while (p < (int*)l[LoopEnd] && (p == start || !labels[p - old_text])) {
+        n = next_op(p);
+        if ((*p == LEA || *p == IMM) && (*n == LI || *n == LC) &&
+            !labels[n - old_text]) {
+            // the load of a variable, a global is in the data segment
+            if ((*p == IMM && (p[1] < (int)old_data || p[1] >= (int)data)) ||
+                loop_stores(l, p)) {
+                return end;
+            }
+            worth = worth | (*p == IMM);
+            p = n + 1;
+        } else if (*p == LEA || *p == IMM) {
+            p = n;
+        } else if (*p == PUSH) {
+            depth++;
+            p = n;
+        } else if (*p >= OR && *p <= MUL && depth) {
+            depth--;
+            worth = 1;
+            p = n;
+        } else {
+            return end;
+        }
+        if (!depth && worth) {
+            end = p;
+        }
+    }
+    return end;
+}
+
+void hoist_invariants() {
+    int *p, *q, *n, *l, *s, *spans, *top, *ent, *buf;
+    int i, frame, size;
+
+    if (!loop_count) {
+        return;
+    }
+    find_labels();
+
+    // the address of each store (see loop_stores)
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+    p = old_text + 1;
+    q = 0;
+    while (p <= text) {
+        if (*p == SI || *p == SC) {
+            if (!marks[p - old_text]) {
+                marks[p - old_text] = -1;
+            }
+        } else if (*p == PUSH && q && (*q == LEA || *q == IMM) &&
+                   (n = pop_of(p)) && (*n == SI || *n == SC)) {
+            marks[n - old_text] = (int)q;
+        }
+        q = p;
+        p = next_op(p);
+    }
+
+    // the innermost loop of each instruction, the inner loops are added
+    // first
+    memset(moved, 0, (text - old_text + 2) * sizeof(int));
+    i = 0;
+    while (i < loop_count) {
+        l = loops + i * LoopSize;
+        p = (int*)l[LoopEntry];
+        while (p < (int*)l[LoopEnd]) {
+            if (!moved[p - old_text]) {
+                moved[p - old_text] = i + 1;
+            }
+            p = next_op(p);
+        }
+        i++;
+    }
+
+    // plan the spans, their locals enlarge the frames
+    size = (text - old_text + 2) * sizeof(int);
+    if (!(spans = top = (int*)reserve(0, 2 * size))) {
+        printf("could not mmap(%ld) for loops\n", 2 * size);
+        exit(-1);
+    }
+    ent = 0;
+    frame = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == ENT) {
+            if (ent) {
+                ent[1] = frame;
+            }
+            ent = p;
+            frame = p[1];
+        }
+        i = moved[p - old_text];
+        if (i && (*p == LEA || *p == IMM) &&
+            (n = invariant_span(p, loops + (i - 1) * LoopSize))) {
+            top[SpanStart] = (int)p;
+            top[SpanEnd] = (int)n;
+            top[SpanSlot] = -++frame;
+            top[SpanLoop] = i;
+            top = top + SpanSize;
+            size = size + (n - p + 4) * sizeof(int);
+            p = n;
+        } else {
+            p = next_op(p);
+        }
+    }
+    if (ent) {
+        ent[1] = frame;
+    }
+    if (top == spans) {
+        return;
+    }
+
+    // rewrite: the spans of a loop go before its entry
+    if (!(buf = (int*)reserve(0, size))) {
+        printf("could not mmap(%ld) for loops\n", size);
+        exit(-1);
+    }
+    q = buf;
+    s = spans;
+    p = old_text + 1;
+    while (p <= text) {
+        i = moved[p - old_text];
+        moved[p - old_text] = (int)(old_text + (q + 1 - buf));
+        if (i && loops[(i - 1) * LoopSize + LoopEntry] == (int)p) {
+            l = spans;
+            while (l < top) {
+                if (l[SpanLoop] == i) {
+                    *++q = LEA;
+                    *++q = l[SpanSlot];
+                    *++q = PUSH;
+                    n = (int*)l[SpanStart];
+                    while (n < (int*)l[SpanEnd]) {
+                        *++q = *n++;
+                    }
+                    *++q = SI;
+                }
+                l = l + SpanSize;
+            }
+        }
+        if (s < top && (int*)s[SpanStart] == p) {
+            n = next_op(p);
+            while (n < (int*)s[SpanEnd]) {
+                moved[n - old_text] = moved[p - old_text];
+                n = next_op(n);
+            }
+            *++q = LEA;
+            *++q = s[SpanSlot];
+            *++q = LI;
+            p = (int*)s[SpanEnd];
+            s = s + SpanSize;
+        } else {
+            n = next_op(p);
+            while (p < n) {
+                *++q = *p++;
+            }
+        }
+    }
+
+    // back to the text segment
+    if (old_text + (q - buf) >= text_end) {
+        printf("the code of the loops is larger than the text segment\n");
+        exit(-1);
+    }
+    p = buf + 1;
+    while (p <= q) {
+        old_text[p - buf] = *p;
+        p++;
+    }
+    relocate(old_text + (q - buf));
+
+    // the arrays of the passes are too small for the new code
+    labels = 0;
+    alloc_passes();
+}
+
+// run the optimizer passes over the text segment
+void optimize() {
+    alloc_passes();
+    hoist_invariants();
+    fuse_stores();
+    fuse_ops();
+    peephole();
+    cache_pushes();
+}
+
+// the register code, -r. to_registers translates the text segment for
+// eval_reg, whose operators read their operands from the frame and write
+// the result to it and to ax: `ADDR d, a, b` is bp[d] = ax = bp[a] + bp[b].
+// the registers are the words of the frame by their index from bp, as for
+// LLI, so the locals and the arguments are registers. the values pushed for
+// an operator go to a temporary register for each depth of the expression,
+// below the locals, and a value which the operator takes from ax goes to a
+// scratch register. the other instructions are kept, they still run on ax
+// and the stack.
+//
+// the translation follows what ax holds without emitting it while it is a
+// register, an immediate or an operator on them, so that
+// `LLI a; PSHB; LLI b; ADDB; SLI c` becomes `ADDR c, a, b`. the value is put
+// in ax before any other instruction and at the jump targets.
+enum { RegAx, RegSlot, RegImm, RegOp };  // what ax holds
+
+int reg_kind,   // one of the kinds
+    reg_op,     // the instruction of RegOp, ORR to MODR or ADRI to MLRI
+    reg_a,      // the register of RegSlot, the value of RegImm or the first
+                // operand of RegOp
+    reg_b;      // the second operand of RegOp
+int *reg_out,    // the last word of the translation
+    *reg_stack,  // the registers of the values pushed for an operator
+    reg_depth,   // the count of these values
+    reg_base,    // the scratch register of the function
+    reg_frame;   // the words of the frame, with the temporaries
+
+// a scratch or temporary register, the frame grows to hold it
+int reg_slot(int r) {
+    if (-r > reg_frame) {
+        reg_frame = -r;
+    }
+    return r;
+}
+
+// write the value which ax holds to register r, ax keeps it
+void reg_to_slot(int r) {
+    if (reg_kind == RegSlot) {
+        *++reg_out = MOVR;
+        *++reg_out = r;
+        *++reg_out = reg_a;
+    } else if (reg_kind == RegImm) {
+        *++reg_out = MOVI;
+        *++reg_out = r;
+        *++reg_out = reg_a;
+    } else if (reg_kind == RegOp) {
+        *++reg_out = reg_op;
+        *++reg_out = r;
+        *++reg_out = reg_a;
+        *++reg_out = reg_b;
+    } else {
+        *++reg_out = SLI;
+        *++reg_out = r;
+    }
+    reg_kind = RegAx;
+}
+
+// emit the value which ax holds
+void reg_to_ax() {
+    if (reg_kind == RegSlot) {
+        *++reg_out = LLI;
+        *++reg_out = reg_a;
+    } else if (reg_kind == RegImm) {
+        *++reg_out = IMM;
+        *++reg_out = reg_a;
+    } else if (reg_kind == RegOp) {
+        reg_to_slot(reg_slot(reg_base));
+    }
+    reg_kind = RegAx;
+}
+
+// the operator which pops the value pushed at p, when it is one of OR to MOD
+// or ORB to MODB, otherwise 0
+int* reg_pop_of(int* p) {
+    int* c;
+
+    if (*p == PUSH) {
+        c = pop_of(p);
+        return c && *c >= OR && *c <= MOD ? c : 0;
+    }
+    c = next_op(p);
+    while (*c < ORB || *c > SCB) {
+        c = next_op(c);
+    }
+    return *c <= MODB ? c : 0;
+}
+
+// check that local r keeps its value from the push at p to the operator at
+// c: nothing between them stores, calls or jumps
+int reg_stable(int* p, int* c, int r) {
+    p = next_op(p);
+    while (p <= c) {
+        if (labels[p - old_text]) {
+            return 0;
+        }
+        if (p < c && !((*p >= OR && *p <= MOD) || (*p >= ORB && *p <= MODB) ||
+                       (*p >= ADDI && *p <= GEI) || *p == PUSH ||
+                       *p == PSHB || *p == LEA || *p == IMM || *p == LI ||
+                       *p == LC || *p == NEG || (*p >= LLI && *p <= LGC) ||
+                       ((*p == SLI || *p == SLC) && p[1] != r))) {
+            return 0;
+        }
+        p = next_op(p);
+    }
+    return 1;
+}
+
+void to_registers() {
+    int *p, *c, *n, *buf, *ent;
+    int op, k, size;
+
+    alloc_passes();
+    size = (text - old_text + 2) * 8 * sizeof(int);
+    if (!(buf = malloc(size)) ||
+        !(reg_stack = malloc((text - old_text + 2) * sizeof(int)))) {
+        printf("could not malloc(%ld) for register code\n", size);
+        exit(-1);
+    }
+    find_labels();
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+
+    // buf stands for the text segment, the code starts at buf + 1
+    reg_out = buf;
+    reg_kind = RegAx;
+    reg_depth = 0;
+    ent = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        op = *p;
+        n = next_op(p);
+        if (labels[p - old_text]) {
+            reg_to_ax();
+        }
+        moved[p - old_text] = (int)(old_text + (reg_out + 1 - buf));
+        if (op == ENT) {
+            // the frame of the function before holds its temporaries
+            if (ent) {
+                *ent = reg_frame;
+            }
+            *++reg_out = ENT;
+            *++reg_out = p[1];
+            ent = reg_out;
+            reg_base = -p[1] - 1;
+            reg_frame = p[1];
+        } else if (op == LLI) {
+            reg_kind = RegSlot;
+            reg_a = p[1];
+        } else if (op == IMM && (p[1] < (int)old_data || p[1] > (int)data)) {
+            // the addresses of data become offsets in an image (see cc_image)
+            reg_kind = RegImm;
+            reg_a = p[1];
+        } else if (op == SLI) {
+            reg_to_slot(p[1]);
+        } else if ((op == PUSH || op == PSHB) && (c = reg_pop_of(p))) {
+            // the value goes to the temporary of this depth, a local stays
+            // where it is when it does not change before the operator
+            marks[c - old_text] = 1;
+            if (reg_kind != RegSlot || !reg_stable(p, c, reg_a)) {
+                reg_to_slot(reg_slot(reg_base - 1 - reg_depth));
+                reg_kind = RegSlot;
+                reg_a = reg_base - 1 - reg_depth;
+            }
+            reg_stack[reg_depth++] = reg_a;
+        } else if (marks[p - old_text]) {
+            // an operator on the pushed value and ax
+            k = op >= ORB ? op - ORB : op - OR;
+            if (reg_kind == RegImm && k >= ADD - OR && k <= MUL - OR) {
+                reg_op = ADRI + k - (ADD - OR);
+                reg_b = reg_a;
+            } else {
+                if (reg_kind != RegSlot) {
+                    reg_to_slot(reg_slot(reg_base));
+                    reg_a = reg_base;
+                }
+                reg_op = ORR + k;
+                reg_b = reg_a;
+            }
+            reg_kind = RegOp;
+            reg_a = reg_stack[--reg_depth];
+        } else if (((op >= ADDI && op <= MULI) ||
+                    (op == SHLI && p[1] >= 0 && p[1] < 64)) &&
+                   (reg_kind == RegSlot || reg_kind == RegOp)) {
+            if (reg_kind == RegOp) {
+                reg_to_slot(reg_slot(reg_base));
+                reg_a = reg_base;
+            }
+            reg_kind = RegOp;
+            if (op == SHLI) {
+                // a multiply costs the same as a shift in the interpreter
+                reg_op = MLRI;
+                reg_b = (int)1 << p[1];
+            } else {
+                reg_op = ADRI + op - ADDI;
+                reg_b = p[1];
+            }
+        } else if (op >= EQJZ && op <= GEJZ && reg_kind == RegSlot) {
+            *++reg_out = EQJI + op - EQJZ;
+            *++reg_out = reg_a;
+            *++reg_out = p[1];
+            *++reg_out = p[2];
+            reg_kind = RegAx;
+        } else if (op == JZ && reg_kind == RegOp && reg_op >= EQR &&
+                   reg_op <= GER) {
+            *++reg_out = EQJR + reg_op - EQR;
+            *++reg_out = reg_a;
+            *++reg_out = reg_b;
+            *++reg_out = p[1];
+            reg_kind = RegAx;
+        } else {
+            reg_to_ax();
+            while (p < n) {
+                *++reg_out = *p++;
+            }
+        }
+        p = n;
+    }
+    if (ent) {
+        *ent = reg_frame;
+    }
+
+    // back to the text segment
+    if (old_text + (reg_out - buf) >= text_end) {
+        printf("the register code is larger than the text segment\n");
+        exit(-1);
+    }
+    p = buf + 1;
+    while (p <= reg_out) {
+        old_text[p - buf] = *p;
+        p++;
+    }
+    relocate(old_text + (reg_out - buf));
+}
+
+// the mnemonic of an instruction, 4 characters which are not terminated
+char* op_name(int op) {
+    return & "LEA ,IMM ,JMP ,CALL,JZ  ,JNZ ,SWCH,ENT ,ADJ ,LEV ,TCAL,LI  ,LC  ,SI  ,SC  ,"
+           "PUSH,"
+           "OR  ,XOR ,AND ,EQ  ,NE  ,LT  ,GT  ,LE  ,GE  ,SHL ,SHR ,ADD ,SUB ,MUL ,DIV ,MOD ,"
+           "NEG ,LLI ,LLC ,LGI ,LGC ,SLI ,SLC ,SGI ,SGC ,ADDI,SUBI,MULI,"
+           "DIVI,MODI,SHLI,SHRI,ANDI,EQI ,NEI ,LTI ,GTI ,LEI ,GEI ,"
+           "EQJZ,NEJZ,LTJZ,GTJZ,LEJZ,GEJZ,"
+           "PSHB,ORB ,XORB,ANDB,EQB ,NEB ,LTB ,GTB ,LEB ,GEB ,SHLB,SHRB,"
+           "ADDB,SUBB,MULB,DIVB,MODB,SIB ,SCB ,IMD ,LDI ,LDC ,SDI ,SDC ,"
+           "OPEN,READ,WRIT,CLOS,PRTF,MALC,MSET,MCMP,MMAP,MADV,LSEK,FORK,WAIT,"
+           "DSYM,JCAL,EXIT,ORR ,XORR,ANDR,EQR ,NER ,LTR ,GTR ,LER ,GER ,SHLR,"
+           "SHRR,ADDR,SUBR,MULR,DIVR,MODR,ADRI,SBRI,MLRI,EQJR,NEJR,LTJR,GTJR,"
+           "LEJR,GEJR,EQJI,NEJI,LTJI,GTJI,LEJI,GEJI,MOVR,MOVI"[op * 5];
+}
+
+// print the instruction at pc for the debug mode, it is kept out of eval so
+// that it does not take the host registers of the interpreter loop
+void show_op(int n, int* pc) {
+    printf("%ld> %.4s", n, op_name(*pc));
+    if (op_args(*pc))
+        printf(" %ld\n", pc[1]);
+    else
+        printf("\n");
+}
+
+// the JIT, it translates the text segment to x86-64 code which keeps the
+// frames of the virtual machine: ax is rax, sp is rsp, bp is rbp and the
+// cached top of the stack bx is rcx. CALL, ENT, ADJ and LEV become native
+// calls and frames, the builtin functions are called in the C library.
+// the registers are numbered as in the instruction encoding: 0 rax, 1 rcx,
+// 2 rdx, 3 rbx, 4 rsp, 5 rbp, 6 rsi, 7 rdi, 8 r8, ...
+
+// emit a byte of native code
+void emit(int b) {
+    *jit_pos++ = b;
+}
+
+// emit a little-endian value of n bytes
+void emit_int(int v, int n) {
+    while (n > 0) {
+        *jit_pos++ = v;
+        v = v >> 8;
+        n--;
+    }
+}
+
+// mov reg, v, sign extended from 32 bits when it fits
+void emit_mov_imm(int reg, int v) {
+    emit(0x48);
+    if (v == (v << 32) >> 32) {
+        emit(0xc7);
+        emit(0xc0 + reg);
+        emit_int(v, 4);
+    } else {
+        emit(0xb8 + reg);
+        emit_int(v, 8);
+    }
+}
+
+// the rel32 of a jump or call to the code of the instruction at target,
+// jit_map is only complete in the second pass
+void emit_rel(int* target) {
+    emit_int(jit_map[target - old_text] - (int)(jit_pos + 4), 4);
+}
+
+// instructions on rax which take an address in reg (eg: 0x8b is mov rax,
+// [reg]), or [rbp + disp] when reg is rbp
+void emit_mem(int rex, int code, int reg, int disp) {
+    if (rex) {
+        emit(rex);
+    }
+    if (code > 255) {
+        emit(code >> 8);
+    }
+    emit(code & 255);
+    if (reg == 5) {
+        emit(0x85);
+        emit_int(disp * sizeof(int), 4);
+    } else {
+        emit(reg);
+    }
+}
+
+// ax = ax, after the comparison, for EQ to GE
+void emit_set(int op) {
+    emit(0x0f);
+    if (op == EQ) {
+        emit(0x94);
+    } else if (op == NE) {
+        emit(0x95);
+    } else if (op == LT) {
+        emit(0x9c);
+    } else if (op == GT) {
+        emit(0x9f);
+    } else if (op == LE) {
+        emit(0x9e);
+    } else {
+        emit(0x9d);
+    }
+    emit(0xc0);
+    emit(0x0f);  // movzx eax, al
+    emit(0xb6);
+    emit(0xc0);
+}
+
+// ax = rcx <op> ax, for OR to MOD
+void emit_alu(int op) {
+    emit(0x48);
+    if (op == OR) {
+        emit(0x09);
+        emit(0xc8);
+    } else if (op == XOR) {
+        emit(0x31);
+        emit(0xc8);
+    } else if (op == AND) {
+        emit(0x21);
+        emit(0xc8);
+    } else if (op == ADD) {
+        emit(0x01);
+        emit(0xc8);
+    } else if (op == SUB) {
+        emit(0x29);  // sub rcx, rax; mov rax, rcx
+        emit(0xc1);
+        emit(0x48);
+        emit(0x89);
+        emit(0xc8);
+    } else if (op == MUL) {
+        emit(0x0f);
+        emit(0xaf);
+        emit(0xc1);
+    } else if (op >= EQ && op <= GE) {
+        emit(0x39);  // cmp rcx, rax
+        emit(0xc1);
+        emit_set(op);
+    } else {
+        emit(0x91);  // xchg rax, rcx
+        emit(0x48);
+        if (op == SHL) {
+            emit(0xd3);
+            emit(0xe0);
+        } else if (op == SHR) {
+            emit(0xd3);
+            emit(0xf8);
+        } else {
+            emit(0x99);  // cqo; idiv rcx
+            emit(0x48);
+            emit(0xf7);
+            emit(0xf9);
+            if (op == MOD) {
+                emit(0x48);  // mov rax, rdx
+                emit(0x89);
+                emit(0xd0);
+            }
+        }
+    }
+}
+
+// ax = ax <op> v, for the immediate versions of ADD, SUB, MUL, AND and EQ
+// to GE
+void emit_alu_imm(int op, int v) {
+    emit_mov_imm(2, v);
+    emit(0x48);
+    if (op == ADD) {
+        emit(0x01);
+        emit(0xd0);
+    } else if (op == SUB) {
+        emit(0x29);
+        emit(0xd0);
+    } else if (op == MUL) {
+        emit(0x0f);
+        emit(0xaf);
+        emit(0xc2);
+    } else if (op == AND) {
+        emit(0x21);
+        emit(0xd0);
+    } else {
+        emit(0x39);  // cmp rax, rdx
+        emit(0xd0);
+        emit_set(op);
+    }
+}
+
+int div_shift;  // the shift after the multiply by the magic number
+
+// the magic number of the signed division by d, which is not a power of two
+// and below 2^61: when 2^(l-1) < d < 2^l, it is m = 2^(63+l) / d + 1 less
+// 2^64, and x / d is ((x * m >> 64) + x) >> (l - 1), plus 1 when x is
+// negative (Granlund and Montgomery). the quotient is computed bit by bit
+int div_magic(int d) {
+    int l, i, r, m;
+
+    l = 1;
+    while (((int)1 << l) < d) {
+        l++;
+    }
+    div_shift = l - 1;
+    r = m = 0;
+    i = 63 + l;
+    while (i >= 0) {
+        r = r * 2 + (i == 63 + l);
+        if (r >= d) {
+            r = r - d;
+            if (i < 64) {
+                m = m | ((int)1 << i);
+            }
+        }
+        i--;
+    }
+    return m + 1;
+}
+
+// ax = ax / d or ax % d for DIVI and MODI, d is positive. the quotient by a
+// power of two is a shift, after d - 1 is added to a negative ax, and the
+// other quotients are a multiply by the magic number, since idiv takes tens
+// of cycles. rcx may hold a value (see PSHB), ax is saved in rsi
+void emit_div(int op, int d) {
+    int k;
+
+    k = 0;
+    while (k < 62 && ((int)1 << k) < d) {
+        k++;
+    }
+    if (d == 1) {
+        if (op == MODI) {
+            emit(0x31);  // xor eax, eax
+            emit(0xc0);
+        }
+        return;
+    }
+    if (((int)1 << k) != d && k >= 61) {
+        emit_mov_imm(6, d);  // mov rsi, d; cqo; idiv rsi
+        emit(0x48);
+        emit(0x99);
+        emit(0x48);
+        emit(0xf7);
+        emit(0xfe);
+        if (op == MODI) {
+            emit(0x48);  // mov rax, rdx
+            emit(0x89);
+            emit(0xd0);
+        }
+        return;
+    }
+
+    emit(0x48);  // mov rsi, rax
+    emit(0x89);
+    emit(0xc6);
+    if (((int)1 << k) == d) {
+        emit(0x48);  // sar rax, 63; shr rax, 64 - k; add rax, rsi
+        emit(0xc1);
+        emit(0xf8);
+        emit(63);
+        emit(0x48);
+        emit(0xc1);
+        emit(0xe8);
+        emit(64 - k);
+        emit(0x48);
+        emit(0x01);
+        emit(0xf0);
+        if (op == DIVI) {
+            emit(0x48);  // sar rax, k
+            emit(0xc1);
+            emit(0xf8);
+            emit(k);
+            return;
+        }
+        emit_alu_imm(AND, -d);
+    } else {
+        emit_mov_imm(0, div_magic(d));
+        emit(0x48);  // imul rsi; add rdx, rsi
+        emit(0xf7);
+        emit(0xee);
+        emit(0x48);
+        emit(0x01);
+        emit(0xf2);
+        if (div_shift) {
+            emit(0x48);  // sar rdx, l - 1
+            emit(0xc1);
+            emit(0xfa);
+            emit(div_shift);
+        }
+        emit(0x48);  // mov rax, rsi; shr rax, 63; add rax, rdx
+        emit(0x89);
+        emit(0xf0);
+        emit(0x48);
+        emit(0xc1);
+        emit(0xe8);
+        emit(63);
+        emit(0x48);
+        emit(0x01);
+        emit(0xd0);
+        if (op == DIVI) {
+            return;
+        }
+        emit_alu_imm(MUL, d);
+    }
+    emit(0x48);  // sub rsi, rax; mov rax, rsi
+    emit(0x29);
+    emit(0xc6);
+    emit(0x48);
+    emit(0x89);
+    emit(0xf0);
+}
+
+// the name of the C library function of a builtin
+char* libc_name(int op) {
+    if (op == OPEN) {
+        return "open";
+    } else if (op == READ) {
+        return "read";
+    } else if (op == WRIT) {
+        return "write";
+    } else if (op == CLOS) {
+        return "close";
+    } else if (op == PRTF) {
+        return "printf";
+    } else if (op == MALC) {
+        return "malloc";
+    } else if (op == MSET) {
+        return "memset";
+    } else if (op == MCMP) {
+        return "memcmp";
+    } else if (op == MMAP) {
+        return "mmap";
+    } else if (op == MADV) {
+        return "madvise";
+    } else if (op == LSEK) {
+        return "lseek";
+    } else if (op == FORK) {
+        return "fork";
+    } else if (op == WAIT) {
+        return "waitpid";
+    } else if (op == DSYM) {
+        return "dlsym";
+    } else if (op == EXIT) {
+        return "exit";
+    }
+    return 0;  // jitcall is not in the library
+}
+
+// call the library function of a builtin through its entry in jit_got
+void emit_call_libc(int op) {
+    jit_uses = jit_uses | (1 << (op - OPEN));
+    emit(0x49);  // mov r11, entry; call [r11]
+    emit(0xbb);
+    emit_int(jit_got + (op - OPEN) * sizeof(int), 8);
+    emit(0x41);
+    emit(0xff);
+    emit(0x13);
+}
+
+// call a builtin, the arguments are on the stack as in eval and go to rdi,
+// rsi, rdx, rcx, r8 and r9. the stack is aligned to 16 bytes for the call
+// and rbx keeps the stack pointer.
+void emit_sys(int* p) {
+    int n, i, reg;
+
+    if (*p == PRTF || *p == OPEN) {
+        n = p[2];  // the count of arguments from the following ADJ
+    } else if (*p == FORK) {
+        n = 0;
+    } else if (*p == CLOS || *p == MALC) {
+        n = 1;
+    } else if (*p == DSYM) {
+        n = 2;
+    } else if (*p == MMAP) {
+        n = 6;
+    } else {
+        n = 3;
+    }
+
+    i = 0;
+    while (i < n && i < 6) {
+        // the registers of the arguments in order, one digit each
+        reg = (0x981267 >> i * 4) & 15;
+        if (*p == JCAL) {
+            // the code of the program in r11, then argc and argv
+            reg = (0x67b >> i * 4) & 15;
+        }
+        emit(reg < 8 ? 0x48 : 0x4c);  // mov reg, [rsp + disp]
+        emit(0x8b);
+        emit(0x84 + (reg & 7) * 8);
+        emit(0x24);
+        emit_int((n - 1 - i) * sizeof(int), 4);
+        i++;
+    }
+
+    emit(0x31);  // xor eax, eax, no vector registers for printf
+    emit(0xc0);
+    emit(0x48);  // mov rbx, rsp
+    emit(0x89);
+    emit(0xe3);
+    emit(0x48);  // and rsp, -16
+    emit(0x83);
+    emit(0xe4);
+    emit(0xf0);
+    if (*p == JCAL) {
+        emit(0x41);  // call r11
+        emit(0xff);
+        emit(0xd3);
+    } else {
+        emit_call_libc(*p);
+    }
+    emit(0x48);  // mov rsp, rbx
+    emit(0x89);
+    emit(0xdc);
+
+    if (*p == OPEN || *p == READ || *p == WRIT || *p == CLOS || *p == PRTF ||
+        *p == MCMP || *p == MADV || *p == FORK || *p == WAIT) {
+        emit(0x48);  // movsxd rax, eax, they return a C int
+        emit(0x63);
+        emit(0xc0);
+    }
+}
+
+// translate the instruction at p
+void jit_op(int* p) {
+    int op, i;
+
+    op = *p;
+    switch (op) {
+        case LEA:
+            emit_mem(0x48, 0x8d, 5, p[1]);
+            break;
+        case IMM:
+            emit_mov_imm(0, p[1]);
+            break;
+        case JMP:
+            emit(0xe9);
+            emit_rel((int*)p[1]);
+            break;
+        case CALL:
+            emit(0xe8);
+            emit_rel((int*)p[1]);
+            break;
+        case JZ:
+        case JNZ:
+            emit(0x48);  // test rax, rax
+            emit(0x85);
+            emit(0xc0);
+            emit(0x0f);
+            emit(op == JZ ? 0x84 : 0x85);
+            emit_rel((int*)p[1]);
+            break;
+        case SWCH:
+            emit_mov_imm(1, p[1]);
+            emit(0x48);  // mov rdx, rax; sub rdx, rcx
+            emit(0x89);
+            emit(0xc2);
+            emit(0x48);
+            emit(0x29);
+            emit(0xca);
+            emit_mov_imm(1, p[2]);
+            emit(0x48);  // cmp rdx, rcx; jae default
+            emit(0x39);
+            emit(0xca);
+            emit(0x0f);
+            emit(0x83);
+            emit_rel((int*)p[3]);
+            emit(0x48);  // lea rcx, [rip + 3]; jmp [rcx + rdx * 8]
+            emit(0x8d);
+            emit(0x0d);
+            emit_int(3, 4);
+            emit(0xff);
+            emit(0x24);
+            emit(0xd1);
+            i = 0;
+            while (i < p[2]) {
+                emit_int(jit_map[(int*)p[4 + i] - old_text] - (int)jit_code +
+                             jit_base,
+                         8);
+                i++;
+            }
+            break;
+        case ENT:
+            emit(0x55);  // push rbp; mov rbp, rsp; sub rsp, n
+            emit(0x48);
+            emit(0x89);
+            emit(0xe5);
+            emit(0x48);
+            emit(0x81);
+            emit(0xec);
+            emit_int(p[1] * sizeof(int), 4);
+            break;
+        case ADJ:
+            emit(0x48);  // add rsp, n
+            emit(0x81);
+            emit(0xc4);
+            emit_int(p[1] * sizeof(int), 4);
+            break;
+        case LEV:
+            emit(0x48);  // mov rsp, rbp; pop rbp; ret
+            emit(0x89);
+            emit(0xec);
+            emit(0x5d);
+            emit(0xc3);
+            break;
+        case TCALL:
+            i = p[2];
+            while (i-- > 0) {
+                emit(0x48);  // mov rcx, [rsp + i]; mov [rbp + 2 + i], rcx
+                emit(0x8b);
+                emit(0x8c);
+                emit(0x24);
+                emit_int(i * sizeof(int), 4);
+                emit(0x48);
+                emit(0x89);
+                emit(0x8d);
+                emit_int((2 + i) * sizeof(int), 4);
+            }
+            emit(0x48);  // mov rsp, rbp; pop rbp; jmp
+            emit(0x89);
+            emit(0xec);
+            emit(0x5d);
+            emit(0xe9);
+            emit_rel((int*)p[1]);
+            break;
+        case LI:
+            emit_mem(0x48, 0x8b, 0, 0);
+            break;
+        case LC:
+            emit_mem(0x48, 0x0fbe, 0, 0);
+            break;
+        case SI:
+        case SC:
+        case SIB:
+        case SCB:
+            if (op == SI || op == SC) {
+                emit(0x59);  // pop rcx
+            }
+            if (op == SI || op == SIB) {
+                emit_mem(0x48, 0x89, 1, 0);
+            } else {
+                emit_mem(0, 0x88, 1, 0);  // mov [rcx], al
+            }
+            if (op == SC || op == SCB) {
+                emit_mem(0x48, 0x0fbe, 0xc0, 0);
+            }
+            break;
+        case PUSH:
+            emit(0x50);
+            break;
+        case PSHB:
+            emit(0x48);  // mov rcx, rax
+            emit(0x89);
+            emit(0xc1);
+            break;
+        case NEG:
+            emit(0x48);
+            emit(0xf7);
+            emit(0xd8);
+            break;
+        case LLI:
+            emit_mem(0x48, 0x8b, 5, p[1]);
+            break;
+        case LLC:
+            emit_mem(0x48, 0x0fbe, 5, p[1]);
+            break;
+        case SLI:
+            emit_mem(0x48, 0x89, 5, p[1]);
+            break;
+        case SLC:
+            emit_mem(0, 0x88, 5, p[1]);
+            emit_mem(0x48, 0x0fbe, 0xc0, 0);
+            break;
+        case LGI:
+        case LGC:
+        case SGI:
+        case SGC:
+            emit_mov_imm(2, p[1]);
+            if (op == LGI) {
+                emit_mem(0x48, 0x8b, 2, 0);
+            } else if (op == LGC) {
+                emit_mem(0x48, 0x0fbe, 2, 0);
+            } else if (op == SGI) {
+                emit_mem(0x48, 0x89, 2, 0);
+            } else {
+                emit_mem(0, 0x88, 2, 0);
+                emit_mem(0x48, 0x0fbe, 0xc0, 0);
+            }
+            break;
+        case ADDI:
+        case SUBI:
+        case MULI:
+            emit_alu_imm(ADD + op - ADDI, p[1]);
+            break;
+        case DIVI:
+        case MODI:
+            emit_div(op, p[1]);
+            break;
+        case SHLI:
+        case SHRI:
+            emit(0x48);  // shl rax, k or sar rax, k
+            emit(0xc1);
+            emit(op == SHLI ? 0xe0 : 0xf8);
+            emit(p[1] & 63);
+            break;
+        case ANDI:
+            emit_alu_imm(AND, p[1]);
+            break;
+        case EQI:
+        case NEI:
+        case LTI:
+        case GTI:
+        case LEI:
+        case GEI:
+            emit_alu_imm(EQ + op - EQI, p[1]);
+            break;
+        case EQJZ:
+        case NEJZ:
+        case LTJZ:
+        case GTJZ:
+        case LEJZ:
+        case GEJZ:
+            emit_alu_imm(EQ + op - EQJZ, p[1]);
+            emit(0x48);  // test rax, rax; jz
+            emit(0x85);
+            emit(0xc0);
+            emit(0x0f);
+            emit(0x84);
+            emit_rel((int*)p[2]);
+            break;
+        case EXIT:
+            emit(0x48);  // mov rax, [rsp]; jmp to the end of jit_run
+            emit(0x8b);
+            emit(0x04);
+            emit(0x24);
+            emit(0xe9);
+            emit_int((int)jit_exit - (int)(jit_pos + 4), 4);
+            break;
+        default:
+            if (op >= OR && op <= MOD) {
+                emit(0x59);  // pop rcx
+                emit_alu(op);
+            } else if (op >= ORB && op <= MODB) {
+                emit_alu(OR + op - ORB);
+            } else {
+                emit_sys(p);
+            }
+    }
+}
+
+// translate the text segment, twice: the first pass finds the native
+// address of every instruction, the second one emits the jumps to them.
+// the code starts with the entry point called by jit_run, it keeps the
+// stack pointer of the host in r15 to return from exit() too.
+int jit_compile() {
+    int pass, *p;
+
+    if (!(jit_map = malloc((text - old_text + 2) * sizeof(int)))) {
+        printf("could not malloc(%ld) for native code map\n",
+               (text - old_text + 2) * sizeof(int));
+        return -1;
+    }
+    pass = 0;
+    while (pass < 2) {
+        jit_pos = jit_code;
+        emit(0x55);  // push rbp; push rbx; push r15; mov r15, rsp
+        emit(0x53);
+        emit(0x41);
+        emit(0x57);
+        emit(0x49);
+        emit(0x89);
+        emit(0xe7);
+        emit(0x57);  // push argc; push argv; call main
+        emit(0x56);
+        emit(0xe8);
+        emit_rel((int*)idmain[Value]);
+        jit_exit = jit_pos;
+        emit(0x4c);  // mov rsp, r15; pop r15; pop rbx; pop rbp; ret
+        emit(0x89);
+        emit(0xfc);
+        emit(0x41);
+        emit(0x5f);
+        emit(0x5b);
+        emit(0x5d);
+        emit(0xc3);
+
+        p = old_text + 1;
+        while (p <= text) {
+            jit_map[p - old_text] = (int)jit_pos;
+            jit_op(p);
+            p = next_op(p);
+        }
+        jit_map[p - old_text] = (int)jit_pos;
+        pass++;
+    }
+    return 0;
+}
+
+// the size of the buffer for the native code, the longest translations are
+// the builtins, at most 80 bytes for a word of the text segment
+int jit_size() {
+    return (text - old_text + 2) * 80 + 64;
+}
+
+// run the program as native code, the same as eval does
+int jit_run(int argc, char** argv) {
+    int size, *got, op;
+
+    size = jit_size();
+    jit_code = (char*)mmap(0, size, 7, 0x22, -1, 0);  // rwx, private anon
+    if ((int)jit_code == -1) {
+        printf("could not mmap(%ld) for native code\n", size);
+        return -1;
+    }
+    if (!(got = malloc((EXIT - OPEN + 1) * sizeof(int)))) {
+        printf("could not malloc(%ld) for library functions\n",
+               (EXIT - OPEN + 1) * sizeof(int));
+        return -1;
+    }
+    op = OPEN;
+    while (op <= EXIT) {
+        if (libc_name(op)) {
+            got[op - OPEN] = (int)dlsym(0, libc_name(op));
+        }
+        op++;
+    }
+    jit_got = (int)got;
+    jit_base = (int)jit_code;
+
+    if (jit_compile() < 0) {
+        return -1;
+    }
+    size = jitcall(jit_code, argc, argv);
+    printf("exit(%ld)\n", size);
+    return size;
+}
+
+// the layout of the executable written by write_elf: the headers and the
+// tables of the dynamic linker in the first page, the native code from the
+// second page and the data segment at the address it had while compiling
+enum { ElfBase = 0x400000, ElfCode = 0x1000, ElfData = 0x10000000 };
+
+// emit a program header of the executable
+void emit_phdr(int type, int flags, int offset, int addr, int size) {
+    emit_int(type, 4);
+    emit_int(flags, 4);
+    emit_int(offset, 8);
+    emit_int(addr, 8);
+    emit_int(addr, 8);
+    emit_int(size, 8);
+    emit_int(size, 8);
+    emit_int(0x1000, 8);
+}
+
+// emit a string with its terminating zero
+void emit_str(char* str) {
+    while (*str) {
+        emit(*str++);
+    }
+    emit(0);
+}
+
+// write the program as a native executable: the code of the JIT linked to
+// the C library by the dynamic linker, which fills the jit_got entries of
+// the builtins which are called. main() gets argc and argv of the process
+// and exit() is called with its return value.
+int write_elf(char* path) {
+    char *buf, *entry;
+    int code_size, data_off, size, fd, op, n;
+    int str, sym, hash, rela, dyn, got, end, names;
+
+    size = ElfCode + jit_size() + 0x1000;
+    if (!(buf = malloc(size))) {
+        printf("could not malloc(%ld) for the executable\n", size);
+        return -1;
+    }
+    memset(buf, 0, size);
+
+    // the tables of the first page, after the headers and the interpreter
+    str = 432;
+    sym = str + 128;
+    hash = sym + (EXIT - OPEN + 1) * 24;
+    rela = hash + (EXIT - OPEN + 4) * 4;
+    dyn = rela + (EXIT - OPEN) * 24;
+    got = dyn + 10 * 16;
+    end = got + (EXIT - OPEN + 1) * sizeof(int);
+
+    jit_code = buf + ElfCode;
+    jit_base = ElfBase + ElfCode;
+    jit_got = ElfBase + got;
+    jit_uses = 1 << (EXIT - OPEN);
+    if (jit_compile() < 0) {
+        return -1;
+    }
+
+    // the entry point: main(argc, argv), then exit()
+    entry = jit_pos;
+    emit(0x48);  // mov rdi, [rsp]; lea rsi, [rsp + 8]; and rsp, -16
+    emit(0x8b);
+    emit(0x3c);
+    emit(0x24);
+    emit(0x48);
+    emit(0x8d);
+    emit(0x74);
+    emit(0x24);
+    emit(0x08);
+    emit(0x48);
+    emit(0x83);
+    emit(0xe4);
+    emit(0xf0);
+    emit(0xe8);  // call the code of jit_compile
+    emit_int((int)jit_code - (int)(jit_pos + 4), 4);
+    emit(0x48);  // mov rdi, rax
+    emit(0x89);
+    emit(0xc7);
+    emit_call_libc(EXIT);
+    code_size = jit_pos - jit_code;
+    data_off = (ElfCode + code_size + 0xfff) & -0x1000;
+
+    // ELF header
+    jit_pos = buf;
+    emit_int(0x010102464c457f, 8);  // magic, 64-bit, little-endian
+    emit_int(0, 8);
+    emit_int(2, 2);   // executable
+    emit_int(62, 2);  // x86-64
+    emit_int(1, 4);
+    emit_int(ElfBase + ElfCode + (entry - jit_code), 8);
+    emit_int(64, 8);  // program headers
+    emit_int(0, 8);   // no section headers
+    emit_int(0, 4);
+    emit_int(64, 2);
+    emit_int(56, 2);
+    emit_int(6, 2);
+    emit_int(64, 2);
+    emit_int(0, 4);
+
+    emit_phdr(6, 4, 64, ElfBase + 64, 6 * 56);        // PT_PHDR
+    emit_phdr(3, 4, 400, ElfBase + 400, 28);          // PT_INTERP
+    emit_phdr(1, 6, 0, ElfBase, end);                 // PT_LOAD, rw
+    emit_phdr(1, 5, ElfCode, ElfBase + ElfCode, code_size);  // rx
+    emit_phdr(1, 6, data_off, (int)old_data, data - old_data);
+    emit_phdr(2, 6, dyn, ElfBase + dyn, 10 * 16);     // PT_DYNAMIC
+    emit_str("/lib64/ld-linux-x86-64.so.2");
+
+    // the names, the symbols and their relocations to the entries of
+    // jit_got. the hash table has one bucket and finds no symbol, this
+    // program exports nothing.
+    jit_pos = buf + str;
+    emit_str("");
+    emit_str("libc.so.6");
+    names = jit_pos - buf;
+    op = OPEN;
+    n = 0;
+    while (op <= EXIT) {
+        if (jit_uses & (1 << (op - OPEN))) {
+            n++;
+            jit_pos = buf + sym + n * 24;
+            emit_int(names - str, 4);
+            emit_int(0x12, 4);  // global function, undefined
+            jit_pos = buf + rela + (n - 1) * 24;
+            emit_int(ElfBase + got + (op - OPEN) * sizeof(int), 8);
+            emit_int(n * 0x100000000 + 1, 8);  // R_X86_64_64
+            emit_int(0, 8);
+            jit_pos = buf + names;
+            emit_str(libc_name(op));
+            names = jit_pos - buf;
+        }
+        op++;
+    }
+    jit_pos = buf + hash;
+    emit_int(1, 4);
+    emit_int(n + 1, 4);
+
+    jit_pos = buf + dyn;
+    emit_int(1, 8);  // DT_NEEDED
+    emit_int(1, 8);
+    emit_int(4, 8);  // DT_HASH
+    emit_int(ElfBase + hash, 8);
+    emit_int(5, 8);  // DT_STRTAB
+    emit_int(ElfBase + str, 8);
+    emit_int(6, 8);  // DT_SYMTAB
+    emit_int(ElfBase + sym, 8);
+    emit_int(10, 8);  // DT_STRSZ
+    emit_int(names - str, 8);
+    emit_int(11, 8);  // DT_SYMENT
+    emit_int(24, 8);
+    emit_int(7, 8);  // DT_RELA
+    emit_int(ElfBase + rela, 8);
+    emit_int(8, 8);  // DT_RELASZ
+    emit_int(n * 24, 8);
+    emit_int(9, 8);  // DT_RELAENT
+    emit_int(24, 8);
+
+    // write it with the mode 0755
+    if ((fd = open(path, 0x241, 493)) < 0) {
+        printf("could not open(%s)\n", path);
+        return -1;
+    }
+    if (write(fd, buf, data_off) != data_off ||
+        write(fd, old_data, data - old_data) != data - old_data) {
+        printf("could not write(%s)\n", path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// the C backend, it writes the program as C source for the host compiler.
+// every function becomes a C function which gets the stack pointer of its
+// arguments. the frames stay on a stack in memory (locals may have their
+// address taken), but the values which a PUSH keeps for an operator become
+// C variables, and so do the locals and arguments whose address is never
+// taken. builtins are calls of the C library.
+char* out_pos;  // where the next character of the C source goes
+int* c_funcs;   // the function which starts at the same offset of text
+int* c_slots;   // the uses of the locals of the current function
+
+// how the locals of a function are used, indexed by their offset from bp
+enum { SlotMax = 1024, SlotLoad = 1, SlotAddr = 2 };
+
+// append a string to the C source
+void out(char* s) {
+    while (*s) {
+        *out_pos++ = *s++;
+    }
+}
+
+void out_hex(int n) {
+    int i;
+
+    out("0x");
+    i = sizeof(int) * 2;
+    while (i > 0) {
+        i--;
+        *out_pos++ = "0123456789abcdef"[(n >> i * 4) & 15];
+    }
+}
+
+void out_num(int n) {
+    if (n == lowest()) {
+        // it has no positive
+        out("(w)");
+        out_hex(n);
+        return;
+    }
+    if (n < 0) {
+        *out_pos++ = '-';
+        n = -n;
+    }
+    if (n >= 10) {
+        out_num(n / 10);
+    }
+    *out_pos++ = '0' + n % 10;
+}
+
+// a value of the text segment, which is made relative to the data segment
+// when it points into it
+void out_val(int v) {
+    if (is_data(v)) {
+        out("(w)((char*)d + ");
+        out_num(v - (int)old_data);
+        out(")");
+    } else {
+        out_num(v);
+    }
+}
+
+void out_label(int* p) {
+    out("L");
+    out_num(p - old_text);
+}
+
+// the value popped by the instruction at p, a C variable when the PUSH was
+// paired with it
+void out_pop(int* p) {
+    if (marks[p - old_text]) {
+        out("t");
+        out_num(marks[p - old_text]);
+    } else {
+        out("*sp++");
+    }
+}
+
+// a local or an argument which is a C variable, or its place in the frame
+int promoted(int n) {
+    return n > -SlotMax && n < SlotMax && c_slots[n + SlotMax] == SlotLoad;
+}
+
+void out_slot(int n, int is_char) {
+    if (promoted(n)) {
+        out(n < 0 ? "l" : "a");
+        out_num(n < 0 ? -n : n);
+    } else if (is_char) {
+        out("*(char*)(bp + ");
+        out_num(n);
+        out(")");
+    } else {
+        out("bp[");
+        out_num(n);
+        out("]");
+    }
+}
+
+// the arguments of a builtin, `, sp[i]` from the i-th one on, n in total
+void out_args(int i, int n) {
+    while (i < n) {
+        out(", sp[");
+        out_num(n - 1 - i);
+        out("]");
+        i++;
+    }
+}
+
+// the operators of OR to MOD, in C
+char* c_operator(int op) {
+    return &"|  ^  &  == != <  >  <= >= << >> +  -  *  /  %  "[(op - OR) * 3];
+}
+
+void out_operator(int op) {
+    char* s;
+
+    s = c_operator(op);
+    *out_pos++ = ' ';
+    *out_pos++ = s[0];
+    if (s[1] != ' ') {
+        *out_pos++ = s[1];
+    }
+    *out_pos++ = ' ';
+}
+
+// translate the instruction at p
+void c_op(int* p) {
+    int op, i;
+
+    op = *p;
+    out("    ");
+    if (op == LEA) {
+        out("ax = (w)(bp + ");
+        out_num(p[1]);
+        out(");");
+    } else if (op == IMM) {
+        out("ax = ");
+        out_val(p[1]);
+        out(";");
+    } else if (op == JMP) {
+        out("goto ");
+        out_label((int*)p[1]);
+        out(";");
+    } else if (op == CALL) {
+        out("ax = f_");
+        out((char*)((int*)c_funcs[(int*)p[1] - old_text])[Name]);
+        out("(sp);");
+    } else if (op == JZ || op == JNZ) {
+        out(op == JZ ? "if (!ax) goto " : "if (ax) goto ");
+        out_label((int*)p[1]);
+        out(";");
+    } else if (op == SWCH) {
+        out("switch (ax) {\n");
+        i = 0;
+        while (i < p[2]) {
+            out("    case ");
+            out_num(p[1] + i);
+            out(": goto ");
+            out_label((int*)p[4 + i]);
+            out(";\n");
+            i++;
+        }
+        out("    default: goto ");
+        out_label((int*)p[3]);
+        out(";\n    }");
+    } else if (op == ENT) {
+        out("bp = sp - 2;\n    sp = bp - ");
+        out_num(p[1]);
+        out(";");
+        i = 2;
+        while (i < SlotMax) {
+            if (promoted(i)) {
+                out("\n    a");
+                out_num(i);
+                out(" = bp[");
+                out_num(i);
+                out("];");
+            }
+            i++;
+        }
+    } else if (op == ADJ) {
+        out("sp = sp + ");
+        out_num(p[1]);
+        out(";");
+    } else if (op == LEV) {
+        out("return ax;");
+    } else if (op == TCALL) {
+        i = p[2];
+        while (i-- > 0) {
+            out("bp[");
+            out_num(2 + i);
+            out("] = sp[");
+            out_num(i);
+            out("];\n    ");
+        }
+        out("return f_");
+        out((char*)((int*)c_funcs[(int*)p[1] - old_text])[Name]);
+        out("(bp + 2);");
+    } else if (op == LI || op == LC) {
+        out(op == LI ? "ax = *(w*)ax;" : "ax = *(char*)ax;");
+    } else if (op == SI || op == SIB) {
+        out("*(w*)");
+        if (op == SI) {
+            out_pop(p);
+        } else {
+            out("bx");
+        }
+        out(" = ax;");
+    } else if (op == SC || op == SCB) {
+        out("ax = *(char*)");
+        if (op == SC) {
+            out_pop(p);
+        } else {
+            out("bx");
+        }
+        out(" = ax;");
+    } else if (op == PUSH) {
+        if (marks[p - old_text]) {
+            out("w t");
+            out_num(marks[p - old_text]);
+            out(" = ax;");
+        } else {
+            out("*--sp = ax;");
+        }
+    } else if (op >= OR && op <= MOD) {
+        out("ax = ");
+        out_pop(p);
+        out_operator(op);
+        out("ax;");
+    } else if (op == NEG) {
+        out("ax = -ax;");
+    } else if (op == LLI || op == LLC) {
+        out("ax = ");
+        if (op == LLC && promoted(p[1])) {
+            out("(char)");
+        }
+        out_slot(p[1], op == LLC);
+        out(";");
+    } else if (op == SLI) {
+        out_slot(p[1], 0);
+        out(" = ax;");
+    } else if (op == SLC) {
+        out("ax = ");
+        out_slot(p[1], 1);
+        out(promoted(p[1]) ? " = (char)ax;" : " = ax;");
+    } else if (op >= LGI && op <= SGC) {
+        if (op != SGI) {
+            out("ax = ");
+        }
+        out(op == LGI || op == SGI ? "*(w*)" : "*(char*)");
+        out_val(p[1]);
+        if (op == SGI || op == SGC) {
+            out(" = ax");
+        }
+        out(";");
+    } else if (op >= ADDI && op <= GEJZ) {
+        out("ax = ax");
+        if (op <= MODI) {
+            out_operator(ADD + op - ADDI);
+        } else if (op == SHLI) {
+            out_operator(SHL);
+        } else if (op == SHRI) {
+            out_operator(SHR);
+        } else if (op == ANDI) {
+            out_operator(AND);
+        } else if (op <= GEI) {
+            out_operator(EQ + op - EQI);
+        } else {
+            out_operator(EQ + op - EQJZ);
+        }
+        out_val(p[1]);
+        out(";");
+        if (op >= EQJZ) {
+            out("\n    if (!ax) goto ");
+            out_label((int*)p[2]);
+            out(";");
+        }
+    } else if (op == PSHB) {
+        out("bx = ax;");
+    } else if (op >= ORB && op <= MODB) {
+        out("ax = bx");
+        out_operator(OR + op - ORB);
+        out("ax;");
+    } else if (op == OPEN) {
+        out("ax = open((char*)sp[");
+        out_num(p[2] - 1);
+        out("]");
+        out_args(1, p[2]);
+        out(");");
+    } else if (op == READ) {
+        out("ax = read(sp[2], (char*)sp[1], sp[0]);");
+    } else if (op == WRIT) {
+        out("ax = write(sp[2], (char*)sp[1], sp[0]);");
+    } else if (op == CLOS) {
+        out("ax = close(sp[0]);");
+    } else if (op == PRTF) {
+        out("ax = printf((char*)sp[");
+        out_num(p[2] - 1);
+        out("]");
+        out_args(1, p[2]);
+        out(");");
+    } else if (op == MALC) {
+        out("ax = (w)malloc(sp[0]);");
+    } else if (op == MSET) {
+        out("ax = (w)memset((char*)sp[2], sp[1], sp[0]);");
+    } else if (op == MCMP) {
+        out("ax = memcmp((char*)sp[2], (char*)sp[1], sp[0]);");
+    } else if (op == MMAP) {
+        out("ax = (w)mmap((char*)sp[5], sp[4], sp[3], sp[2], sp[1], sp[0]);");
+    } else if (op == MADV) {
+        out("ax = madvise((char*)sp[2], sp[1], sp[0]);");
+    } else if (op == LSEK) {
+        out("ax = lseek(sp[2], sp[1], sp[0]);");
+    } else if (op == FORK) {
+        out("ax = fork();");
+    } else if (op == WAIT) {
+        out("ax = waitpid(sp[2], (void*)sp[1], sp[0]);");
+    } else if (op == DSYM) {
+        out("ax = (w)dlsym((char*)sp[1], (char*)sp[0]);");
+    } else if (op == JCAL) {
+        out("ax = ((w (*)(w, char**))sp[2])(sp[1], (char**)sp[0]);");
+    } else if (op == EXIT) {
+        out("exit(sp[0]);");
+    }
+    out("\n");
+}
+
+// start the C function of the guest function id at p, the locals whose
+// address is never taken become C variables
+void c_function(int* id, int* p) {
+    int n;
+
+    memset(c_slots, 0, SlotMax * 2 * sizeof(int));
+    n = 0;
+    while (p <= text && (!n || !c_funcs[p - old_text])) {
+        if (*p == LEA && p[1] > -SlotMax && p[1] < SlotMax) {
+            c_slots[p[1] + SlotMax] = SlotAddr;
+        } else if (*p >= LLI && *p <= SLC && *p != LGI && *p != LGC &&
+                   p[1] > -SlotMax && p[1] < SlotMax) {
+            c_slots[p[1] + SlotMax] = c_slots[p[1] + SlotMax] | SlotLoad;
+        }
+        n = 1;
+        p = next_op(p);
+    }
+
+    out("\nw f_");
+    out((char*)id[Name]);
+    out("(w* sp) {\n    w *bp, ax, bx;\n");
+    n = 1 - SlotMax;
+    while (n < SlotMax) {
+        if (promoted(n)) {
+            out("    w ");
+            out(n < 0 ? "l" : "a");
+            out_num(n < 0 ? -n : n);
+            out(";\n");
+        }
+        n++;
+    }
+}
+
+// write the program as C source, to be built with the same size of int as
+// cc has
+int write_c(char* path) {
+    int *p, *c, *id, i, fd, size;
+    char* buf;
+
+    alloc_passes();
+    size = (text - old_text) * 160 + (data - old_data) * 5 + 4096;
+    if (!(buf = out_pos = malloc(size)) ||
+        !(c_funcs = malloc((text - old_text + 2) * sizeof(int))) ||
+        !(c_slots = malloc(SlotMax * 2 * sizeof(int)))) {
+        printf("could not malloc(%ld) for the C source\n", size);
+        return -1;
+    }
+
+    // the functions, the labels and the pairs of PUSH and pop
+    find_labels();
+    memset(c_funcs, 0, (text - old_text + 2) * sizeof(int));
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+    out("#include <dlfcn.h>\n#include <fcntl.h>\n#include <stdio.h>\n");
+    out("#include <stdlib.h>\n#include <string.h>\n#include <sys/mman.h>\n");
+    out("#include <sys/wait.h>\n#include <unistd.h>\n\n");
+    out(sizeof(int) == 8 ? "typedef long long w;\n" : "typedef int w;\n");
+    i = 0;
+    while (i <= sym_mask) {
+        id = (int*)sym_index[i];
+        if (id && id[Class] == Fun) {
+            c_funcs[(int*)id[Value] - old_text] = (int)id;
+            out("w f_");
+            out((char*)id[Name]);
+            out("(w* sp);\n");
+        }
+        i++;
+    }
+    p = old_text + 1;
+    while (p <= text) {
+        if (*p == PUSH && (c = pop_of(p))) {
+            marks[p - old_text] = p - old_text;
+            marks[c - old_text] = p - old_text;
+        }
+        p = next_op(p);
+    }
+
+    // the data segment, as words
+    out("\nw d[] = {");
+    i = 0;
+    while (i <= (data - old_data) / sizeof(int)) {
+        out(i % 4 ? " " : "\n    ");
+        out_hex(((int*)old_data)[i]);
+        out(",");
+        i++;
+    }
+    out("\n};\n");
+
+    p = old_text + 1;
+    while (p <= text) {
+        if (c_funcs[p - old_text]) {
+            if (p != old_text + 1) {
+                out("}\n");
+            }
+            c_function((int*)c_funcs[p - old_text], p);
+        }
+        if (labels[p - old_text]) {
+            out_label(p);
+            out(":;\n");
+        }
+        c_op(p);
+        p = next_op(p);
+    }
+    out("}\n\nint main(int argc, char** argv) {\n    w* sp;\n\n");
+    out("    sp = (w*)malloc(");
+    out_num(stack_size);
+    out(") + ");
+    out_num(stack_size / sizeof(int));
+    out(";\n    *--sp = argc;\n    *--sp = (w)argv;\n    return f_main(sp);\n}\n");
+
+    if ((fd = open(path, 0x241, 420)) < 0) {
+        printf("could not open(%s)\n", path);
+        return -1;
+    }
+    size = out_pos - buf;
+    if (write(fd, buf, size) != size) {
+        printf("could not write(%s)\n", path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// the output of -o is C source when its name ends with .c and bytecode when
+// it ends with .bc
+int ends_with(char* path, char* ext) {
+    char* p;
+
+    p = ext;
+    while (*path) {
+        path++;
+    }
+    while (*p) {
+        p++;
+    }
+    while (p > ext && path[-1] == p[-1]) {
+        path--;
+        p--;
+    }
+    return p == ext;
+}
+
+// the bytecode file, the text and the data segments as they are after the
+// optimizer, so that a run of the same program skips program(). the header
+// fills the first page, then each segment starts on a page of its own and is
+// mapped at the start of the segment it is loaded into. the words of the
+// text segment which hold an address are relative in the file, a relocation
+// after the data gives their offset and their kind:
+// +------+-------+------+-------------+
+// |header| text  | data | relocations |
+// +------+-------+------+-------------+
+// header: magic, version, word size, key, text words, data bytes, main, the
+// offsets of data and relocations, count of relocations and file size. an
+// object of a translation unit (see compile_unit) has its symbols after the
+// relocations, their offset and count follow in the header.
+enum { BcMagic = 0x63346263, BcVersion = 4, BcPage = 4096 };
+enum { BcText, BcData, BcSym };  // kinds of relocation, a word offset in the
+                                 // text segment, a byte offset in the data
+                                 // segment or the symbol of a call
+int* bc_text;   // the text segment in the file being written
+int* bc_rel;    // its relocations
+int bc_count;   // the count of relocations
+char* cache;    // the directory of cached bytecode (see cache_path)
+
+int page_up(int n) {
+    return (n + BcPage - 1) & -BcPage;
+}
+
+// make the word at p of the text segment relative to its segment, the
+// symbol of a call is already a number
+void bc_reloc(int* p, int kind) {
+    if (kind == BcText) {
+        bc_text[p - old_text] = (int*)*p - old_text;
+    } else if (kind == BcData) {
+        bc_text[p - old_text] = *p - (int)old_data;
+    }
+    bc_rel[bc_count++] = (p - old_text) * 4 + kind;
+}
+
+// an operand which points into the data segment, as in out_val
+void bc_data(int* p) {
+    if (is_data(*p)) {
+        bc_reloc(p, BcData);
+    }
+}
+
+// the size of the image, at most one relocation for each word of the text
+// segment
+int bc_size() {
+    return page_up(BcPage + (text - old_text + 1) * sizeof(int)) +
+           page_up(data - old_data) + (text - old_text + 1) * sizeof(int);
+}
+
+// write the image of the segments to buf, which has bc_size() bytes. the
+// calls marked in marks are to the symbol of the same number less one.
+// returns the size of the image
+int bc_image(char* buf, int key) {
+    int *p, *q, *head, words;
+    char* d;
+
+    words = text - old_text + 1;
+    memset(buf, 0, bc_size());
+    head = (int*)buf;
+    head[7] = page_up(BcPage + words * sizeof(int));
+    head[8] = head[7] + page_up(data - old_data);
+    bc_text = (int*)(buf + BcPage);
+    bc_rel = (int*)(buf + head[8]);
+    bc_count = 0;
+
+    p = old_text;
+    while (p <= text) {
+        bc_text[p - old_text] = *p;
+        p++;
+    }
+    d = old_data;
+    while (d < data) {
+        buf[head[7] + (d - old_data)] = *d;
+        d++;
+    }
+    p = old_text + 1;
+    while (p <= text) {
+        if ((q = data_operand(p))) {
+            bc_data(q);
+        }
+        if ((*p == CALL || *p == TCALL) && marks[p + 1 - old_text]) {
+            bc_reloc(p + 1, BcSym);
+        } else if (*p == JMP || *p == JZ || *p == JNZ || *p == CALL ||
+                   *p == TCALL) {
+            bc_reloc(p + 1, BcText);
+        } else if (*p >= EQJZ && *p <= GEJZ) {
+            bc_reloc(p + 2, BcText);
+        } else if (*p == SWCH) {
+            q = p + 3;
+            while (q < p + 4 + p[2]) {
+                bc_reloc(q, BcText);
+                q++;
+            }
+        }
+        p = next_op(p);
+    }
+
+    head[0] = BcMagic;
+    head[1] = BcVersion;
+    head[2] = sizeof(int);
+    head[3] = key;
+    head[4] = words;
+    head[5] = data - old_data;
+    head[6] = idmain[Value] ? (int*)idmain[Value] - old_text : 0;
+    head[9] = bc_count;
+    head[10] = head[8] + bc_count * sizeof(int);
+    return head[10];
+}
+
+int write_bc(char* path, int key) {
+    int size, fd;
+    char* buf;
+
+    alloc_passes();
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+    if (!(buf = malloc(bc_size()))) {
+        printf("could not malloc(%ld) for bytecode\n", bc_size());
+        return -1;
+    }
+    size = bc_image(buf, key);
+
+    if ((fd = open(path, 0x241, 420)) < 0) {
+        printf("could not open(%s)\n", path);
+        return -1;
+    }
+    if (write(fd, buf, size) != size) {
+        printf("could not write(%s)\n", path);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+// load the bytecode file fd into the segments, when it was written with the
+// key (any key when it is 0). returns 0 when it is not such a file
+int load_bc(int fd, int key) {
+    int *head, *p, *end, size, words;
+
+    size = lseek(fd, 0, 2);  // SEEK_END
+    if (size < BcPage) {
+        return 0;
+    }
+    head = (int*)mmap(0, size, 1, 2, fd, 0);  // PROT_READ, MAP_PRIVATE
+    if ((int)head == -1 || head[0] != BcMagic || head[1] != BcVersion ||
+        head[2] != sizeof(int) || (key && head[3] != key) ||
+        head[10] != size) {
+        return 0;
+    }
+    words = head[4];
+    if (words * sizeof(int) > text_size || head[5] > data_size) {
+        printf("bytecode is larger than the segments\n");
+        exit(-1);
+    }
+
+    // map the segments in place, then move the addresses to them
+    if ((int*)mmap((char*)old_text, words * sizeof(int), 3, 0x12, fd,
+                   BcPage) != old_text ||
+        (head[5] &&
+         (char*)mmap(old_data, head[5], 3, 0x12, fd, head[7]) != old_data)) {
+        printf("could not mmap(%ld) for bytecode\n", size);
+        exit(-1);
+    }
+    p = (int*)((char*)head + head[8]);
+    end = p + head[9];
+    while (p < end) {
+        if ((*p & 3) == BcText) {
+            old_text[*p >> 2] = (int)(old_text + old_text[*p >> 2]);
+        } else {
+            old_text[*p >> 2] = (int)(old_data + old_text[*p >> 2]);
+        }
+        p++;
+    }
+    text = old_text + words - 1;
+    data = old_data + head[5];
+    idmain[Value] = (int)(old_text + head[6]);
+    return 1;
+}
+
+// the key of a source is a hash of its text, the optimization level and the
+// version. the cached bytecode is the file named after the key in the cache
+int source_key(char* s, int n) {
+    int key;
+
+    key = 2166136261 + opt * 16 + BcVersion;  // FNV-1a
+    while (n > 0) {
+        key = (key ^ *s++) * 16777619;
+        n--;
+    }
+    return key ? key : 1;
+}
+
+char* cache_path(int key) {
+    char* path;
+
+    out_pos = path = malloc(BcPage);
+    out(cache);
+    out("/");
+    out_hex(key);
+    out(".bc");
+    *out_pos = 0;
+    return path;
+}
+
+// the profiler, -p. eval calls profile before each instruction, which counts
+// the instruction and follows the calls: a CALL pushes the function and the
+// count of instructions at its entry, a LEV pops them and a TCALL does both.
+// only the outermost activation of a function adds to its inclusive count,
+// so that recursion is not counted twice. the report is printed when the
+// program exits.
+int *prof_hits,    // the count of each instruction, by offset in text
+    *prof_fn,      // the function of each word of text, a number or -1
+    *prof_funcs,   // the identifiers of the functions, by number
+    *prof_incl,    // the inclusive count of instructions of each function
+    *prof_active,  // the activations of each function being run
+    *prof_stack,   // the calls being run, function and count at entry
+    *prof_top;     // the top of prof_stack
+int prof_count;    // the count of functions
+
+void prof_setup() {
+    int *id, i, f, words;
+
+    words = text - old_text + 2;
+    if (!(prof_hits = (int*)reserve(0, words * sizeof(int))) ||
+        !(prof_fn = (int*)reserve(0, words * sizeof(int))) ||
+        !(prof_funcs = (int*)reserve(0, words * sizeof(int))) ||
+        !(prof_incl = (int*)reserve(0, words * sizeof(int))) ||
+        !(prof_active = (int*)reserve(0, words * sizeof(int))) ||
+        !(prof_stack = prof_top = (int*)reserve(0, stack_size))) {
+        printf("could not mmap(%ld) for profile\n", words * sizeof(int));
+        exit(-1);
+    }
+
+    // number the functions, each word of text belongs to the function which
+    // starts before it
+    prof_count = 0;
+    i = 0;
+    while (i <= sym_mask) {
+        id = (int*)sym_index[i];
+        if (id && id[Class] == Fun) {
+            prof_funcs[prof_count] = (int)id;
+            prof_fn[(int*)id[Value] - old_text] = ++prof_count;
+        }
+        i++;
+    }
+    f = -1;
+    i = 0;
+    while (i < words) {
+        if (prof_fn[i]) {
+            f = prof_fn[i] - 1;
+        }
+        prof_fn[i] = f;
+        i++;
+    }
+
+    // main is entered without a CALL
+    f = prof_fn[(int*)idmain[Value] - old_text];
+    *prof_top++ = f;
+    *prof_top++ = 0;
+    if (f >= 0) {
+        prof_active[f]++;
+    }
+}
+
+// the function on top of prof_stack returns after n instructions
+void prof_leave(int n) {
+    int f;
+
+    prof_top = prof_top - 2;
+    f = prof_top[0];
+    if (f >= 0 && --prof_active[f] == 0) {
+        prof_incl[f] = prof_incl[f] + n - prof_top[1];
+    }
+}
+
+// the instruction at pc is the n-th one to run
+void profile(int* pc, int n) {
+    int f;
+
+    if (pc < old_text || pc > text) {
+        return;  // the exit of main, on the stack
+    }
+    prof_hits[pc - old_text]++;
+    if (*pc == TCALL) {
+        prof_leave(n);  // the caller returns, then the callee is called
+    }
+    if (*pc == CALL || *pc == TCALL) {
+        f = prof_fn[(int*)pc[1] - old_text];
+        *prof_top++ = f;
+        *prof_top++ = n;
+        if (f >= 0) {
+            prof_active[f]++;
+        }
+    } else if (*pc == LEV && prof_top > prof_stack) {
+        prof_leave(n);
+    }
+}
+
+// print n as a share of total, in percent
+void print_share(int n, int total) {
+    n = n * 1000 / (total > 0 ? total : 1);
+    printf(" %3ld.%ld%%", n / 10, n % 10);
+}
+
+// the name of the function of number f
+char* prof_name(int f) {
+    return f < 0 ? "?" : (char*)((int*)prof_funcs[f])[Name];
+}
+
+// the report of the profile: the instructions by opcode, the functions with
+// the most instructions, the calls between functions and the listing of the
+// functions which ran, with the line and the count of each instruction
+void prof_report(int total) {
+    int *p, *ops, *excl, *edges, *callees, i, f, best, count, line_i;
+
+    while (prof_top > prof_stack) {
+        prof_leave(total);  // the functions which called exit
+    }
+    if (!(ops = (int*)reserve(0, (EXIT + 1) * sizeof(int))) ||
+        !(excl = (int*)reserve(0, (prof_count + 1) * sizeof(int))) ||
+        !(edges = (int*)reserve(0, (prof_count + 1) * sizeof(int))) ||
+        !(callees = (int*)reserve(0, (prof_count + 1) * sizeof(int)))) {
+        printf("could not mmap(%ld) for profile\n", prof_count * sizeof(int));
+        exit(-1);
+    }
+    p = old_text + 1;
+    while (p <= text) {
+        ops[*p] = ops[*p] + prof_hits[p - old_text];
+        if (prof_fn[p - old_text] >= 0) {
+            excl[prof_fn[p - old_text]] =
+                excl[prof_fn[p - old_text]] + prof_hits[p - old_text];
+        }
+        p = next_op(p);
+    }
+
+    printf("\nprofile: %ld instructions\n\n       count  share  opcode\n", total);
+    while (1) {
+        best = 0;
+        i = 1;
+        while (i <= EXIT) {
+            if (ops[i] > ops[best]) {
+                best = i;
+            }
+            i++;
+        }
+        if (!ops[best]) {
+            break;
+        }
+        printf("%12ld", ops[best]);
+        print_share(ops[best], total);
+        printf("  %.4s\n", op_name(best));
+        ops[best] = 0;
+    }
+
+    printf("\n   exclusive  share   inclusive  share       calls  function\n");
+    i = 0;
+    while (i < 20) {
+        best = -1;
+        f = 0;
+        while (f < prof_count) {
+            if (excl[f] > 0 && (best < 0 || excl[f] > excl[best])) {
+                best = f;
+            }
+            f++;
+        }
+        if (best < 0) {
+            break;
+        }
+        printf("%12ld", excl[best]);
+        print_share(excl[best], total);
+        printf("%12ld", prof_incl[best]);
+        print_share(prof_incl[best], total);
+        printf("%12ld  %s\n",
+               prof_hits[(int*)((int*)prof_funcs[best])[Value] - old_text],
+               prof_name(best));
+        excl[best] = -excl[best];
+        i++;
+    }
+
+    // the calls, the call sites of a function are merged by callee
+    printf("\n       calls  caller -> callee\n");
+    p = old_text + 1;
+    count = 0;
+    while (p <= text) {
+        if ((*p == CALL || *p == TCALL) && prof_hits[p - old_text]) {
+            f = prof_fn[(int*)p[1] - old_text];
+            if (f >= 0) {
+                if (!edges[f]) {
+                    callees[count++] = f;
+                }
+                edges[f] = edges[f] + prof_hits[p - old_text];
+            }
+        }
+        p = next_op(p);
+        if (count &&
+            (p > text || prof_fn[p - old_text] != prof_fn[p - 1 - old_text])) {
+            while (count > 0) {
+                f = callees[--count];
+                printf("%12ld  %s -> %s\n", edges[f],
+                       prof_name(prof_fn[p - 1 - old_text]), prof_name(f));
+                edges[f] = 0;
+            }
+        }
+    }
+
+    printf("\n  line        hits  instruction\n");
+    line_i = 0;
+    p = old_text + 1;
+    while (p <= text) {
+        f = prof_fn[p - old_text];
+        while (line_i + 1 < line_count &&
+               line_map[line_i * 2 + 2] <= p - old_text) {
+            line_i++;
+        }
+        if (f >= 0 && prof_hits[(int*)((int*)prof_funcs[f])[Value] - old_text]) {
+            if ((int*)((int*)prof_funcs[f])[Value] == p) {
+                printf("%s:\n", prof_name(f));
+            }
+            if (line_count && line_map[line_i * 2] <= p - old_text) {
+                printf("%6ld", line_map[line_i * 2 + 1]);
+            } else {
+                printf("      ");
+            }
+            printf("%12ld  %ld: %.4s", prof_hits[p - old_text], p - old_text,
+                   op_name(*p));
+            if (*p == JMP || *p == JZ || *p == JNZ || *p == CALL) {
+                printf(" %ld", (int*)p[1] - old_text);  // the offset of the target
+            } else if (*p == TCALL) {
+                printf(" %ld %ld", (int*)p[1] - old_text, p[2]);
+            } else if (*p >= EQJZ && *p <= GEJZ) {
+                printf(" %ld %ld", p[1], (int*)p[2] - old_text);
+            } else if (op_args(*p)) {
+                printf(" %ld", p[1]);
+            }
+            printf("\n");
+        }
+        p = next_op(p);
+    }
+}
+
+// the binary trace, -trace=file. eval_trace writes a record of each
+// instruction to a buffer, which is written to the file when it is full and
+// when the program exits: the address of the instruction, its opcode, and ax
+// and sp before it runs. the file starts with a header: magic, version, word
+// size and the address of the text segment. cc prints a trace file which is
+// given instead of a source, as in the debug mode.
+enum { TraceMagic = 0x63347472, TraceVersion = 3, TraceRecords = 65536 };
+enum { TracePc, TraceOp, TraceAx, TraceSp, TraceSize };
+int trace_fd;     // the file of the trace, 0 when not tracing
+int *trace_buf,   // the records which are not written yet
+    *trace_pos,   // the next record
+    *trace_end;   // the end of the buffer
+
+void trace_flush() {
+    int size;
+
+    size = (trace_pos - trace_buf) * sizeof(int);
+    if (write(trace_fd, (char*)trace_buf, size) != size) {
+        printf("could not write the trace\n");
+        exit(-1);
+    }
+    trace_pos = trace_buf;
+}
+
+// start the trace of the program in the text segment
+void trace_open(char* path) {
+    if ((trace_fd = open(path, 0x241, 420)) < 0 ||
+        !(trace_buf = trace_pos =
+              malloc(TraceRecords * TraceSize * sizeof(int)))) {
+        printf("could not open(%s)\n", path);
+        exit(-1);
+    }
+    trace_end = trace_buf + TraceRecords * TraceSize;
+    trace_pos[0] = TraceMagic;
+    trace_pos[1] = TraceVersion;
+    trace_pos[2] = sizeof(int);
+    trace_pos[3] = (int)old_text;
+    trace_pos = trace_pos + 4;
+}
+
+// print the trace in the file, which is mapped, as the debug mode does. the
+// offset of an instruction in the text segment follows its mnemonic
+int print_trace(int* p, int size) {
+    int *end, base, n;
+
+    if (p[1] != TraceVersion || p[2] != sizeof(int)) {
+        printf("the trace is of another version of cc\n");
+        return -1;
+    }
+    end = p + size / sizeof(int);
+    base = p[3];
+    n = 0;
+    p = p + 4;
+    while (p + TraceSize <= end) {
+        n++;
+        if (p[TraceOp] < 0 || p[TraceOp] > EXIT) {
+            printf("%ld> bad opcode %ld\n", n, p[TraceOp]);
+            return -1;
+        }
+        printf("%ld> %.4s %ld ax %ld sp %lx\n", n, op_name(p[TraceOp]),
+               (p[TracePc] - base) / (int)sizeof(int), p[TraceAx], p[TraceSp]);
+        p = p + TraceSize;
+    }
+    return 0;
+}
+
+// the entry point of the virtual machine, used to interpret the object code
+// the registers are kept in local variables while running, so the host
+// compiler does not reload them after every store through a guest pointer
+// bp: base pointer
+// sp: stack pointer
+// pc: program counter, points to the next instruction
+// ax: normal register, used for storing the calculated result
+// bx: the top of the stack, when it is cached (see cache_pushes)
+// db: the data segment of the instance, for the text of an image
+// the instance in gets the count of instructions which were executed
+enum { InImage, InStack, InData, InCycle, InstanceSize };
+
+int eval(int* pc, int* sp, int* in) {
+    int op, *tmp;
+    int *bp, ax, bx, n;
+    char* db;
+
+    db = (char*)in[InData];
+    bp = sp;
+    ax = bx = 0;
+    n = 0;
+    while (1) {
+        n++;
+        op = *pc++;  // get next operation code
+
+        // the switch is compiled to a jump table, both by the host compiler
+        // and by this compiler (see SWCH)
+        switch (op) {
+            case IMM:
+                ax = *pc++;  // load immediate value to ax
+                break;
+            case LC:
+                ax = *(char*)ax;  // load character to ax, address in ax
+                break;
+            case LI:
+                ax = *(int*)ax;  // load int to ax, address in ax
+                break;
+            case SC:
+                // save character to address, value in ax, address on stack
+                // sp++ is equal to stack pop
+                ax = *(char*)*sp++ = ax;
+                break;
+            case SI:
+                // save integer to address, value in ax, address on stack
+                *(int*)*sp++ = ax;
+                break;
+            case PUSH:
+                *--sp = ax;  // push the current value into the stack
+                break;
+            case JMP:
+                // pc is used to store the position of next instruction
+                // jump to the next instruction
+                pc = (int*)*pc;
+                break;
+            case JZ:
+                // jump if ax is equal to zero
+                pc = ax ? pc + 1 : (int*)*pc;
+                break;
+            case JNZ:
+                // jump if ax is not equal to zero
+                pc = ax ? (int*)*pc : pc + 1;
+                break;
+            case SWCH:
+                // jump through the table, pc: lowest value, number of
+                // entries, default address and the entries
+                tmp = pc;
+                pc = (int*)pc[2];
+                if (ax >= tmp[0] && ax - tmp[0] < tmp[1]) {
+                    pc = (int*)tmp[3 + ax - tmp[0]];
+                }
+                break;
+            case CALL:
+                *--sp = (int)(pc + 1);  // store following address into stack
+                pc = (int*)*pc;         // call subroutine to function address
+                break;
+            // return from subroutine, replaced by LEV
+            // case REF:
+            //     pc = (int*)*sp++;
+            //     break;
+            case ENT:
+                // make new call frame
+                *--sp = (int)bp;  // store the current base pointer
+                bp = sp;          // base pointer will be the current stack pointer
+                sp = sp - *pc++;  // set some place for local variable
+                break;
+            case ADJ:
+                // remove argument from frame
+                sp = sp + *pc++;
+                break;
+            case LEV:
+                // restore call frame and PC
+                // no need additional REF instruction
+                sp = bp;           // reset the sp
+                bp = (int*)*sp++;  // recover the bp from stack
+                pc = (int*)*sp++;  // the return address pushed by CALL
+                break;
+            case TCALL:
+                // a tail call: the arguments replace the first ones of the
+                // function (it has at least as many), its frame is left as
+                // by LEV but the return address stays for the callee. bx is
+                // free at a call
+                bx = pc[1];
+                while (bx-- > 0) {
+                    bp[2 + bx] = sp[bx];
+                }
+                sp = bp;
+                bp = (int*)*sp++;
+                pc = (int*)*pc;
+                break;
+            case LEA:
+                // load address for the arguments
+                ax = (int)(bp + *pc++);
+                break;
+            // operator instruction set, from c4
+            // The first parameter is placed at the top of the stack, and the
+            // second parameter is placed in ax
+            case OR:
+                ax = *sp++ | ax;
+                break;
+            case XOR:
+                ax = *sp++ ^ ax;
+                break;
+            case AND:
+                ax = *sp++ & ax;
+                break;
+            case EQ:
+                ax = *sp++ == ax;
+                break;
+            case NE:
+                ax = *sp++ != ax;
+                break;
+            case LT:
+                ax = *sp++ < ax;
+                break;
+            case LE:
+                ax = *sp++ <= ax;
+                break;
+            case GT:
+                ax = *sp++ > ax;
+                break;
+            case GE:
+                ax = *sp++ >= ax;
+                break;
+            case SHL:
+                ax = *sp++ << ax;
+                break;
+            case SHR:
+                ax = *sp++ >> ax;
+                break;
+            case ADD:
+                ax = *sp++ + ax;
+                break;
+            case SUB:
+                ax = *sp++ - ax;
+                break;
+            case MUL:
+                ax = *sp++ * ax;
+                break;
+            case DIV:
+                ax = *sp++ / ax;
+                break;
+            case MOD:
+                ax = *sp++ % ax;
+                break;
+            case NEG:
+                ax = -ax;
+                break;
+            // superinstructions
+            case LLI:
+                ax = *(bp + *pc++);  // load local int
+                break;
+            case LLC:
+                ax = *(char*)(bp + *pc++);  // load local char
+                break;
+            case LGI:
+                ax = *(int*)*pc++;  // load global int
+                break;
+            case LGC:
+                ax = *(char*)*pc++;  // load global char
+                break;
+            case SLI:
+                *(bp + *pc++) = ax;  // store local int
+                break;
+            case SLC:
+                ax = *(char*)(bp + *pc++) = ax;  // store local char
+                break;
+            case SGI:
+                *(int*)*pc++ = ax;  // store global int
+                break;
+            case SGC:
+                ax = *(char*)*pc++ = ax;  // store global char
+                break;
+            case ADDI:
+                ax = ax + *pc++;
+                break;
+            case SUBI:
+                ax = ax - *pc++;
+                break;
+            case MULI:
+                ax = ax * *pc++;
+                break;
+            case DIVI:
+                ax = ax / *pc++;
+                break;
+            case MODI:
+                ax = ax % *pc++;
+                break;
+            case SHLI:
+                ax = ax << *pc++;
+                break;
+            case SHRI:
+                ax = ax >> *pc++;
+                break;
+            case ANDI:
+                ax = ax & *pc++;
+                break;
+            case EQI:
+                ax = ax == *pc++;
+                break;
+            case NEI:
+                ax = ax != *pc++;
+                break;
+            case LTI:
+                ax = ax < *pc++;
+                break;
+            case GTI:
+                ax = ax > *pc++;
+                break;
+            case LEI:
+                ax = ax <= *pc++;
+                break;
+            case GEI:
+                ax = ax >= *pc++;
+                break;
+            // compare with the immediate, then jump if the result is zero
+            case EQJZ:
+                ax = ax == *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case NEJZ:
+                ax = ax != *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LTJZ:
+                ax = ax < *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GTJZ:
+                ax = ax > *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LEJZ:
+                ax = ax <= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GEJZ:
+                ax = ax >= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            // the same as the operators above, but the first parameter is
+            // cached in bx instead of being on the stack
+            case PSHB:
+                bx = ax;
+                break;
+            case ORB:
+                ax = bx | ax;
+                break;
+            case XORB:
+                ax = bx ^ ax;
+                break;
+            case ANDB:
+                ax = bx & ax;
+                break;
+            case EQB:
+                ax = bx == ax;
+                break;
+            case NEB:
+                ax = bx != ax;
+                break;
+            case LTB:
+                ax = bx < ax;
+                break;
+            case GTB:
+                ax = bx > ax;
+                break;
+            case LEB:
+                ax = bx <= ax;
+                break;
+            case GEB:
+                ax = bx >= ax;
+                break;
+            case SHLB:
+                ax = bx << ax;
+                break;
+            case SHRB:
+                ax = bx >> ax;
+                break;
+            case ADDB:
+                ax = bx + ax;
+                break;
+            case SUBB:
+                ax = bx - ax;
+                break;
+            case MULB:
+                ax = bx * ax;
+                break;
+            case DIVB:
+                ax = bx / ax;
+                break;
+            case MODB:
+                ax = bx % ax;
+                break;
+            case SIB:
+                *(int*)bx = ax;
+                break;
+            case SCB:
+                ax = *(char*)bx = ax;
+                break;
+            case IMD:
+                ax = (int)(db + *pc++);
+                break;
+            case LDI:
+                ax = *(int*)(db + *pc++);
+                break;
+            case LDC:
+                ax = *(char*)(db + *pc++);
+                break;
+            case SDI:
+                *(int*)(db + *pc++) = ax;
+                break;
+            case SDC:
+                ax = *(char*)(db + *pc++) = ax;
+                break;
+            // some build in function
+            case EXIT:
+                in[InCycle] = n;
+                printf("exit(%ld)\n", *sp);
+                return *sp;
+            case OPEN:
+                // the mode is only passed when the file is created
+                tmp = sp + pc[1];
+                ax = open((char*)tmp[-1], tmp[-2], tmp[-3]);
+                break;
+            case CLOS:
+                ax = close(*sp);
+                break;
+            case READ:
+                ax = read(sp[2], (char*)sp[1], *sp);
+                break;
+            case WRIT:
+                ax = write(sp[2], (char*)sp[1], *sp);
+                break;
+            case PRTF:
+                tmp = sp + pc[1];
+                ax = printf((char*)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5],
+                            tmp[-6]);
+                break;
+            case MALC:
+                ax = (int)malloc(*sp);
+                break;
+            case MSET:
+                ax = (int)memset((char*)sp[2], sp[1], *sp);
+                break;
+            case MCMP:
+                ax = memcmp((char*)sp[2], (char*)sp[1], *sp);
+                break;
+            case MMAP:
+                ax = (int)mmap((char*)sp[5], sp[4], sp[3], sp[2], sp[1], *sp);
+                break;
+            case MADV:
+                ax = madvise((char*)sp[2], sp[1], *sp);
+                break;
+            case LSEK:
+                ax = lseek(sp[2], sp[1], *sp);
+                break;
+            case FORK:
+                ax = fork();
+                break;
+            case WAIT:
+                ax = waitpid(sp[2], (void*)sp[1], *sp);
+                break;
+            case DSYM:
+                ax = (int)dlsym((char*)sp[1], (char*)*sp);
+                break;
+            case JCAL:
+                ax = jitcall(sp[2], sp[1], (char**)*sp);
+                break;
+            default:
+                in[InCycle] = n;
+                printf("unknown instruction:%ld\n", op);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// the instrumented copy of eval, for the debug mode, the profiler and the
+// trace. it is only selected when one of them is on (see cc_run), so that
+// eval runs without a check before each instruction. its instructions must
+// be kept the same as the ones of eval.
+int eval_trace(int* pc, int* sp, int* in) {
+    int op, *tmp;
+    int *bp, ax, bx, n;
+    char* db;
+
+    db = (char*)in[InData];
+    bp = sp;
+    ax = bx = 0;
+    n = 0;
+    while (1) {
+        n++;
+        op = *pc++;  // get next operation code
+
+        // the instrumentation, before the instruction runs
+        if (debug) {
+            show_op(n, pc - 1);
+        }
+        if (prof) {
+            profile(pc - 1, n);
+        }
+        if (trace_fd) {
+            if (trace_pos == trace_end) {
+                trace_flush();
+            }
+            trace_pos[0] = (int)(pc - 1);
+            trace_pos[1] = op;
+            trace_pos[2] = ax;
+            trace_pos[3] = (int)sp;
+            trace_pos = trace_pos + TraceSize;
+        }
+
+        // the switch is compiled to a jump table, both by the host compiler
+        // and by this compiler (see SWCH)
+        switch (op) {
+            case IMM:
+                ax = *pc++;  // load immediate value to ax
+                break;
+            case LC:
+                ax = *(char*)ax;  // load character to ax, address in ax
+                break;
+            case LI:
+                ax = *(int*)ax;  // load int to ax, address in ax
+                break;
+            case SC:
+                // save character to address, value in ax, address on stack
+                // sp++ is equal to stack pop
+                ax = *(char*)*sp++ = ax;
+                break;
+            case SI:
+                // save integer to address, value in ax, address on stack
+                *(int*)*sp++ = ax;
+                break;
+            case PUSH:
+                *--sp = ax;  // push the current value into the stack
+                break;
+            case JMP:
+                // pc is used to store the position of next instruction
+                // jump to the next instruction
+                pc = (int*)*pc;
+                break;
+            case JZ:
+                // jump if ax is equal to zero
+                pc = ax ? pc + 1 : (int*)*pc;
+                break;
+            case JNZ:
+                // jump if ax is not equal to zero
+                pc = ax ? (int*)*pc : pc + 1;
+                break;
+            case SWCH:
+                // jump through the table, pc: lowest value, number of
+                // entries, default address and the entries
+                tmp = pc;
+                pc = (int*)pc[2];
+                if (ax >= tmp[0] && ax - tmp[0] < tmp[1]) {
+                    pc = (int*)tmp[3 + ax - tmp[0]];
+                }
+                break;
+            case CALL:
+                *--sp = (int)(pc + 1);  // store following address into stack
+                pc = (int*)*pc;         // call subroutine to function address
+                break;
+            // return from subroutine, replaced by LEV
+            // case REF:
+            //     pc = (int*)*sp++;
+            //     break;
+            case ENT:
+                // make new call frame
+                *--sp = (int)bp;  // store the current base pointer
+                bp = sp;          // base pointer will be the current stack pointer
+                sp = sp - *pc++;  // set some place for local variable
+                break;
+            case ADJ:
+                // remove argument from frame
+                sp = sp + *pc++;
+                break;
+            case LEV:
+                // restore call frame and PC
+                // no need additional REF instruction
+                sp = bp;           // reset the sp
+                bp = (int*)*sp++;  // recover the bp from stack
+                pc = (int*)*sp++;  // the return address pushed by CALL
+                break;
+            case TCALL:
+                // a tail call: the arguments replace the first ones of the
+                // function (it has at least as many), its frame is left as
+                // by LEV but the return address stays for the callee. bx is
+                // free at a call
+                bx = pc[1];
+                while (bx-- > 0) {
+                    bp[2 + bx] = sp[bx];
+                }
+                sp = bp;
+                bp = (int*)*sp++;
+                pc = (int*)*pc;
+                break;
+            case LEA:
+                // load address for the arguments
+                ax = (int)(bp + *pc++);
+                break;
+            // operator instruction set, from c4
+            // The first parameter is placed at the top of the stack, and the
+            // second parameter is placed in ax
+            case OR:
+                ax = *sp++ | ax;
+                break;
+            case XOR:
+                ax = *sp++ ^ ax;
+                break;
+            case AND:
+                ax = *sp++ & ax;
+                break;
+            case EQ:
+                ax = *sp++ == ax;
+                break;
+            case NE:
+                ax = *sp++ != ax;
+                break;
+            case LT:
+                ax = *sp++ < ax;
+                break;
+            case LE:
+                ax = *sp++ <= ax;
+                break;
+            case GT:
+                ax = *sp++ > ax;
+                break;
+            case GE:
+                ax = *sp++ >= ax;
+                break;
+            case SHL:
+                ax = *sp++ << ax;
+                break;
+            case SHR:
+                ax = *sp++ >> ax;
+                break;
+            case ADD:
+                ax = *sp++ + ax;
+                break;
+            case SUB:
+                ax = *sp++ - ax;
+                break;
+            case MUL:
+                ax = *sp++ * ax;
+                break;
+            case DIV:
+                ax = *sp++ / ax;
+                break;
+            case MOD:
+                ax = *sp++ % ax;
+                break;
+            case NEG:
+                ax = -ax;
+                break;
+            // superinstructions
+            case LLI:
+                ax = *(bp + *pc++);  // load local int
+                break;
+            case LLC:
+                ax = *(char*)(bp + *pc++);  // load local char
+                break;
+            case LGI:
+                ax = *(int*)*pc++;  // load global int
+                break;
+            case LGC:
+                ax = *(char*)*pc++;  // load global char
+                break;
+            case SLI:
+                *(bp + *pc++) = ax;  // store local int
+                break;
+            case SLC:
+                ax = *(char*)(bp + *pc++) = ax;  // store local char
+                break;
+            case SGI:
+                *(int*)*pc++ = ax;  // store global int
+                break;
+            case SGC:
+                ax = *(char*)*pc++ = ax;  // store global char
+                break;
+            case ADDI:
+                ax = ax + *pc++;
+                break;
+            case SUBI:
+                ax = ax - *pc++;
+                break;
+            case MULI:
+                ax = ax * *pc++;
+                break;
+            case DIVI:
+                ax = ax / *pc++;
+                break;
+            case MODI:
+                ax = ax % *pc++;
+                break;
+            case SHLI:
+                ax = ax << *pc++;
+                break;
+            case SHRI:
+                ax = ax >> *pc++;
+                break;
+            case ANDI:
+                ax = ax & *pc++;
+                break;
+            case EQI:
+                ax = ax == *pc++;
+                break;
+            case NEI:
+                ax = ax != *pc++;
+                break;
+            case LTI:
+                ax = ax < *pc++;
+                break;
+            case GTI:
+                ax = ax > *pc++;
+                break;
+            case LEI:
+                ax = ax <= *pc++;
+                break;
+            case GEI:
+                ax = ax >= *pc++;
+                break;
+            // compare with the immediate, then jump if the result is zero
+            case EQJZ:
+                ax = ax == *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case NEJZ:
+                ax = ax != *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LTJZ:
+                ax = ax < *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GTJZ:
+                ax = ax > *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LEJZ:
+                ax = ax <= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GEJZ:
+                ax = ax >= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            // the same as the operators above, but the first parameter is
+            // cached in bx instead of being on the stack
+            case PSHB:
+                bx = ax;
+                break;
+            case ORB:
+                ax = bx | ax;
+                break;
+            case XORB:
+                ax = bx ^ ax;
+                break;
+            case ANDB:
+                ax = bx & ax;
+                break;
+            case EQB:
+                ax = bx == ax;
+                break;
+            case NEB:
+                ax = bx != ax;
+                break;
+            case LTB:
+                ax = bx < ax;
+                break;
+            case GTB:
+                ax = bx > ax;
+                break;
+            case LEB:
+                ax = bx <= ax;
+                break;
+            case GEB:
+                ax = bx >= ax;
+                break;
+            case SHLB:
+                ax = bx << ax;
+                break;
+            case SHRB:
+                ax = bx >> ax;
+                break;
+            case ADDB:
+                ax = bx + ax;
+                break;
+            case SUBB:
+                ax = bx - ax;
+                break;
+            case MULB:
+                ax = bx * ax;
+                break;
+            case DIVB:
+                ax = bx / ax;
+                break;
+            case MODB:
+                ax = bx % ax;
+                break;
+            case SIB:
+                *(int*)bx = ax;
+                break;
+            case SCB:
+                ax = *(char*)bx = ax;
+                break;
+            case IMD:
+                ax = (int)(db + *pc++);
+                break;
+            case LDI:
+                ax = *(int*)(db + *pc++);
+                break;
+            case LDC:
+                ax = *(char*)(db + *pc++);
+                break;
+            case SDI:
+                *(int*)(db + *pc++) = ax;
+                break;
+            case SDC:
+                ax = *(char*)(db + *pc++) = ax;
+                break;
+            // some build in function
+            case EXIT:
+                in[InCycle] = n;
+                printf("exit(%ld)\n", *sp);
+                return *sp;
+            case OPEN:
+                // the mode is only passed when the file is created
+                tmp = sp + pc[1];
+                ax = open((char*)tmp[-1], tmp[-2], tmp[-3]);
+                break;
+            case CLOS:
+                ax = close(*sp);
+                break;
+            case READ:
+                ax = read(sp[2], (char*)sp[1], *sp);
+                break;
+            case WRIT:
+                ax = write(sp[2], (char*)sp[1], *sp);
+                break;
+            case PRTF:
+                tmp = sp + pc[1];
+                ax = printf((char*)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5],
+                            tmp[-6]);
+                break;
+            case MALC:
+                ax = (int)malloc(*sp);
+                break;
+            case MSET:
+                ax = (int)memset((char*)sp[2], sp[1], *sp);
+                break;
+            case MCMP:
+                ax = memcmp((char*)sp[2], (char*)sp[1], *sp);
+                break;
+            case MMAP:
+                ax = (int)mmap((char*)sp[5], sp[4], sp[3], sp[2], sp[1], *sp);
+                break;
+            case MADV:
+                ax = madvise((char*)sp[2], sp[1], *sp);
+                break;
+            case LSEK:
+                ax = lseek(sp[2], sp[1], *sp);
+                break;
+            case FORK:
+                ax = fork();
+                break;
+            case WAIT:
+                ax = waitpid(sp[2], (void*)sp[1], *sp);
+                break;
+            case DSYM:
+                ax = (int)dlsym((char*)sp[1], (char*)*sp);
+                break;
+            case JCAL:
+                ax = jitcall(sp[2], sp[1], (char**)*sp);
+                break;
+            default:
+                in[InCycle] = n;
+                printf("unknown instruction:%ld\n", op);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// the interpreter of the register code (see to_registers), a copy of eval
+// with the instructions of the registers
+int eval_reg(int* pc, int* sp, int* in) {
+    int op, *tmp;
+    int *bp, ax, bx, n;
+    char* db;
+
+    db = (char*)in[InData];
+    bp = sp;
+    ax = bx = 0;
+    n = 0;
+    while (1) {
+        n++;
+        op = *pc++;  // get next operation code
+
+        // the switch is compiled to a jump table, both by the host compiler
+        // and by this compiler (see SWCH)
+        switch (op) {
+            case IMM:
+                ax = *pc++;  // load immediate value to ax
+                break;
+            case LC:
+                ax = *(char*)ax;  // load character to ax, address in ax
+                break;
+            case LI:
+                ax = *(int*)ax;  // load int to ax, address in ax
+                break;
+            case SC:
+                // save character to address, value in ax, address on stack
+                // sp++ is equal to stack pop
+                ax = *(char*)*sp++ = ax;
+                break;
+            case SI:
+                // save integer to address, value in ax, address on stack
+                *(int*)*sp++ = ax;
+                break;
+            case PUSH:
+                *--sp = ax;  // push the current value into the stack
+                break;
+            case JMP:
+                // pc is used to store the position of next instruction
+                // jump to the next instruction
+                pc = (int*)*pc;
+                break;
+            case JZ:
+                // jump if ax is equal to zero
+                pc = ax ? pc + 1 : (int*)*pc;
+                break;
+            case JNZ:
+                // jump if ax is not equal to zero
+                pc = ax ? (int*)*pc : pc + 1;
+                break;
+            case SWCH:
+                // jump through the table, pc: lowest value, number of
+                // entries, default address and the entries
+                tmp = pc;
+                pc = (int*)pc[2];
+                if (ax >= tmp[0] && ax - tmp[0] < tmp[1]) {
+                    pc = (int*)tmp[3 + ax - tmp[0]];
+                }
+                break;
+            case CALL:
+                *--sp = (int)(pc + 1);  // store following address into stack
+                pc = (int*)*pc;         // call subroutine to function address
+                break;
+            // return from subroutine, replaced by LEV
+            // case REF:
+            //     pc = (int*)*sp++;
+            //     break;
+            case ENT:
+                // make new call frame
+                *--sp = (int)bp;  // store the current base pointer
+                bp = sp;          // base pointer will be the current stack pointer
+                sp = sp - *pc++;  // set some place for local variable
+                break;
+            case ADJ:
+                // remove argument from frame
+                sp = sp + *pc++;
+                break;
+            case LEV:
+                // restore call frame and PC
+                // no need additional REF instruction
+                sp = bp;           // reset the sp
+                bp = (int*)*sp++;  // recover the bp from stack
+                pc = (int*)*sp++;  // the return address pushed by CALL
+                break;
+            case TCALL:
+                // a tail call: the arguments replace the first ones of the
+                // function (it has at least as many), its frame is left as
+                // by LEV but the return address stays for the callee. bx is
+                // free at a call
+                bx = pc[1];
+                while (bx-- > 0) {
+                    bp[2 + bx] = sp[bx];
+                }
+                sp = bp;
+                bp = (int*)*sp++;
+                pc = (int*)*pc;
+                break;
+            case LEA:
+                // load address for the arguments
+                ax = (int)(bp + *pc++);
+                break;
+            // operator instruction set, from c4
+            // The first parameter is placed at the top of the stack, and the
+            // second parameter is placed in ax
+            case OR:
+                ax = *sp++ | ax;
+                break;
+            case XOR:
+                ax = *sp++ ^ ax;
+                break;
+            case AND:
+                ax = *sp++ & ax;
+                break;
+            case EQ:
+                ax = *sp++ == ax;
+                break;
+            case NE:
+                ax = *sp++ != ax;
+                break;
+            case LT:
+                ax = *sp++ < ax;
+                break;
+            case LE:
+                ax = *sp++ <= ax;
+                break;
+            case GT:
+                ax = *sp++ > ax;
+                break;
+            case GE:
+                ax = *sp++ >= ax;
+                break;
+            case SHL:
+                ax = *sp++ << ax;
+                break;
+            case SHR:
+                ax = *sp++ >> ax;
+                break;
+            case ADD:
+                ax = *sp++ + ax;
+                break;
+            case SUB:
+                ax = *sp++ - ax;
+                break;
+            case MUL:
+                ax = *sp++ * ax;
+                break;
+            case DIV:
+                ax = *sp++ / ax;
+                break;
+            case MOD:
+                ax = *sp++ % ax;
+                break;
+            case NEG:
+                ax = -ax;
+                break;
+            // superinstructions
+            case LLI:
+                ax = *(bp + *pc++);  // load local int
+                break;
+            case LLC:
+                ax = *(char*)(bp + *pc++);  // load local char
+                break;
+            case LGI:
+                ax = *(int*)*pc++;  // load global int
+                break;
+            case LGC:
+                ax = *(char*)*pc++;  // load global char
+                break;
+            case SLI:
+                *(bp + *pc++) = ax;  // store local int
+                break;
+            case SLC:
+                ax = *(char*)(bp + *pc++) = ax;  // store local char
+                break;
+            case SGI:
+                *(int*)*pc++ = ax;  // store global int
+                break;
+            case SGC:
+                ax = *(char*)*pc++ = ax;  // store global char
+                break;
+            case ADDI:
+                ax = ax + *pc++;
+                break;
+            case SUBI:
+                ax = ax - *pc++;
+                break;
+            case MULI:
+                ax = ax * *pc++;
+                break;
+            case DIVI:
+                ax = ax / *pc++;
+                break;
+            case MODI:
+                ax = ax % *pc++;
+                break;
+            case SHLI:
+                ax = ax << *pc++;
+                break;
+            case SHRI:
+                ax = ax >> *pc++;
+                break;
+            case ANDI:
+                ax = ax & *pc++;
+                break;
+            case EQI:
+                ax = ax == *pc++;
+                break;
+            case NEI:
+                ax = ax != *pc++;
+                break;
+            case LTI:
+                ax = ax < *pc++;
+                break;
+            case GTI:
+                ax = ax > *pc++;
+                break;
+            case LEI:
+                ax = ax <= *pc++;
+                break;
+            case GEI:
+                ax = ax >= *pc++;
+                break;
+            // compare with the immediate, then jump if the result is zero
+            case EQJZ:
+                ax = ax == *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case NEJZ:
+                ax = ax != *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LTJZ:
+                ax = ax < *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GTJZ:
+                ax = ax > *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case LEJZ:
+                ax = ax <= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            case GEJZ:
+                ax = ax >= *pc;
+                pc = ax ? pc + 2 : (int*)pc[1];
+                break;
+            // the same as the operators above, but the first parameter is
+            // cached in bx instead of being on the stack
+            case PSHB:
+                bx = ax;
+                break;
+            case ORB:
+                ax = bx | ax;
+                break;
+            case XORB:
+                ax = bx ^ ax;
+                break;
+            case ANDB:
+                ax = bx & ax;
+                break;
+            case EQB:
+                ax = bx == ax;
+                break;
+            case NEB:
+                ax = bx != ax;
+                break;
+            case LTB:
+                ax = bx < ax;
+                break;
+            case GTB:
+                ax = bx > ax;
+                break;
+            case LEB:
+                ax = bx <= ax;
+                break;
+            case GEB:
+                ax = bx >= ax;
+                break;
+            case SHLB:
+                ax = bx << ax;
+                break;
+            case SHRB:
+                ax = bx >> ax;
+                break;
+            case ADDB:
+                ax = bx + ax;
+                break;
+            case SUBB:
+                ax = bx - ax;
+                break;
+            case MULB:
+                ax = bx * ax;
+                break;
+            case DIVB:
+                ax = bx / ax;
+                break;
+            case MODB:
+                ax = bx % ax;
+                break;
+            case SIB:
+                *(int*)bx = ax;
+                break;
+            case SCB:
+                ax = *(char*)bx = ax;
+                break;
+            case IMD:
+                ax = (int)(db + *pc++);
+                break;
+            case LDI:
+                ax = *(int*)(db + *pc++);
+                break;
+            case LDC:
+                ax = *(char*)(db + *pc++);
+                break;
+            case SDI:
+                *(int*)(db + *pc++) = ax;
+                break;
+            case SDC:
+                ax = *(char*)(db + *pc++) = ax;
+                break;
+            // the register code
+            case ORR:
+                ax = bp[*pc] = bp[pc[1]] | bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case XORR:
+                ax = bp[*pc] = bp[pc[1]] ^ bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case ANDR:
+                ax = bp[*pc] = bp[pc[1]] & bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case EQR:
+                ax = bp[*pc] = bp[pc[1]] == bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case NER:
+                ax = bp[*pc] = bp[pc[1]] != bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case LTR:
+                ax = bp[*pc] = bp[pc[1]] < bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case GTR:
+                ax = bp[*pc] = bp[pc[1]] > bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case LER:
+                ax = bp[*pc] = bp[pc[1]] <= bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case GER:
+                ax = bp[*pc] = bp[pc[1]] >= bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case SHLR:
+                ax = bp[*pc] = bp[pc[1]] << bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case SHRR:
+                ax = bp[*pc] = bp[pc[1]] >> bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case ADDR:
+                ax = bp[*pc] = bp[pc[1]] + bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case SUBR:
+                ax = bp[*pc] = bp[pc[1]] - bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case MULR:
+                ax = bp[*pc] = bp[pc[1]] * bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case DIVR:
+                ax = bp[*pc] = bp[pc[1]] / bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case MODR:
+                ax = bp[*pc] = bp[pc[1]] % bp[pc[2]];
+                pc = pc + 3;
+                break;
+            case ADRI:
+                ax = bp[*pc] = bp[pc[1]] + pc[2];
+                pc = pc + 3;
+                break;
+            case SBRI:
+                ax = bp[*pc] = bp[pc[1]] - pc[2];
+                pc = pc + 3;
+                break;
+            case MLRI:
+                ax = bp[*pc] = bp[pc[1]] * pc[2];
+                pc = pc + 3;
+                break;
+            // compare two registers, or a register and the immediate, then
+            // jump if the result is zero
+            case EQJR:
+                ax = bp[*pc] == bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case NEJR:
+                ax = bp[*pc] != bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case LTJR:
+                ax = bp[*pc] < bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case GTJR:
+                ax = bp[*pc] > bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case LEJR:
+                ax = bp[*pc] <= bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case GEJR:
+                ax = bp[*pc] >= bp[pc[1]];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case EQJI:
+                ax = bp[*pc] == pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case NEJI:
+                ax = bp[*pc] != pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case LTJI:
+                ax = bp[*pc] < pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case GTJI:
+                ax = bp[*pc] > pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case LEJI:
+                ax = bp[*pc] <= pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case GEJI:
+                ax = bp[*pc] >= pc[1];
+                pc = ax ? pc + 3 : (int*)pc[2];
+                break;
+            case MOVR:
+                ax = bp[*pc] = bp[pc[1]];
+                pc = pc + 2;
+                break;
+            case MOVI:
+                ax = bp[*pc] = pc[1];
+                pc = pc + 2;
+                break;
+            // some build in function
+            case EXIT:
+                in[InCycle] = n;
+                printf("exit(%ld)\n", *sp);
+                return *sp;
+            case OPEN:
+                // the mode is only passed when the file is created
+                tmp = sp + pc[1];
+                ax = open((char*)tmp[-1], tmp[-2], tmp[-3]);
+                break;
+            case CLOS:
+                ax = close(*sp);
+                break;
+            case READ:
+                ax = read(sp[2], (char*)sp[1], *sp);
+                break;
+            case WRIT:
+                ax = write(sp[2], (char*)sp[1], *sp);
+                break;
+            case PRTF:
+                tmp = sp + pc[1];
+                ax = printf((char*)tmp[-1], tmp[-2], tmp[-3], tmp[-4], tmp[-5],
+                            tmp[-6]);
+                break;
+            case MALC:
+                ax = (int)malloc(*sp);
+                break;
+            case MSET:
+                ax = (int)memset((char*)sp[2], sp[1], *sp);
+                break;
+            case MCMP:
+                ax = memcmp((char*)sp[2], (char*)sp[1], *sp);
+                break;
+            case MMAP:
+                ax = (int)mmap((char*)sp[5], sp[4], sp[3], sp[2], sp[1], *sp);
+                break;
+            case MADV:
+                ax = madvise((char*)sp[2], sp[1], *sp);
+                break;
+            case LSEK:
+                ax = lseek(sp[2], sp[1], *sp);
+                break;
+            case FORK:
+                ax = fork();
+                break;
+            case WAIT:
+                ax = waitpid(sp[2], (void*)sp[1], *sp);
+                break;
+            case DSYM:
+                ax = (int)dlsym((char*)sp[1], (char*)*sp);
+                break;
+            case JCAL:
+                ax = jitcall(sp[2], sp[1], (char**)*sp);
+                break;
+            default:
+                in[InCycle] = n;
+                printf("unknown instruction:%ld\n", op);
+                return -1;
+        }
+    }
+    return 0;
+}
+
+// the value of the option s when it starts with name, or 0
+char* option(char* s, char* name) {
+    while (*name) {
+        if (*s++ != *name++) {
+            return 0;
+        }
+    }
+    return s;
+}
+
+// a size of the command line, with an optional k, m or g. -1 if it is bad.
+int parse_size(char* s) {
+    int n;
+
+    n = 0;
+    if (*s < '0' || *s > '9') {
+        return -1;
+    }
+    while (*s >= '0' && *s <= '9') {
+        n = n * 10 + *s++ - '0';
+    }
+    if (*s == 'k' || *s == 'K') {
+        n = n * 1024;
+        s++;
+    } else if (*s == 'm' || *s == 'M') {
+        n = n * 1024 * 1024;
+        s++;
+    } else if (*s == 'g' || *s == 'G') {
+        n = n * 1024 * 1024 * 1024;
+        s++;
+    }
+    return *s ? -1 : n;
+}
+
+// open the source file path, - is the standard input. a regular file is
+// mapped whole, in a zero page more for the EOF character. a pipe has no
+// size, it is read in chunks by next. returns the file
+int open_source(char* path) {
+    int fd, n;
+
+    if (!memcmp(path, "-", 2)) {
+        fd = 0;
+    } else if ((fd = open(path, 0)) < 0) {
+        printf("could not open(%s)\n", path);
+        exit(-1);
+    }
+    if ((n = lseek(fd, 0, 2)) >= 0) {  // SEEK_END
+        if (!(src = old_src = reserve(0, n + 1)) ||
+            (n > 0 && (char*)mmap(src, n, 1, 0x12, fd, 0) != src)) {
+            printf("could not mmap(%ld) for source area\n", n);
+            exit(-1);
+        }
+    } else {
+        if (!(src = old_src = src_buf = malloc(SrcChunk + 1))) {
+            printf("could not malloc(%ld) for source buffer\n", (int)SrcChunk + 1);
+            exit(-1);
+        }
+        src_fd = fd;
+        src_end = src;
+    }
+    return fd;
+}
+
+// report the functions which are called but only declared
+int check_defined() {
+    int *id, i, n;
+
+    n = 0;
+    i = 0;
+    while (i <= sym_mask) {
+        id = (int*)sym_index[i];
+        if (id && id[Class] == Ext && id[Value]) {
+            printf("undefined function %s\n", (char*)id[Name]);
+            n++;
+        }
+        i++;
+    }
+    return n;
+}
+
+// translation units: with -u, every file is compiled at the same time by a
+// child process in its own copy of the segments. a child writes its unit as
+// an object to a shared mapping, then the objects are linked into the
+// segments. the symbols of the units are merged by name, a global declared
+// in several units is the same variable and a call of a function which is
+// only declared goes to its definition in another unit.
+char** units;   // the source files
+int unit_count;
+int unit_size;  // the size of the mapping for each object
+
+// the length of a name
+int name_len(char* name) {
+    char* p;
+
+    p = name;
+    while (*p) {
+        p++;
+    }
+    return p - name;
+}
+
+// the symbol after sym in an object
+int* symbol_of(int* sym) {
+    return sym + 3 + (name_len((char*)(sym + 3)) + sizeof(int)) / sizeof(int);
+}
+
+// write the unit as an object to obj: the image of its segments, then its
+// symbols as class, type, value relative to its segment and name
+void write_object(char* obj) {
+    int *id, *p, *next, *head, *sym, i, n, pass;
+    char *name, *d;
+
+    alloc_passes();
+    memset(marks, 0, (text - old_text + 2) * sizeof(int));
+    head = (int*)obj;
+    pass = 0;
+    while (pass < 2) {
+        // number the symbols, the calls of a declared function get its number
+        n = 0;
+        i = 0;
+        while (i <= sym_mask) {
+            id = (int*)sym_index[i];
+            if (id && (id[Class] == Fun || id[Class] == Glo ||
+                       (id[Class] == Ext && id[Value]))) {
+                if (pass == 0 && id[Class] == Ext) {
+                    p = (int*)id[Value];
+                    while (p) {
+                        next = (int*)*p;
+                        *p = n;
+                        marks[p - old_text] = n + 1;
+                        p = next;
+                    }
+                } else if (pass == 1) {
+                    name = (char*)id[Name];
+                    if ((char*)(sym + 4) + name_len(name) > obj + unit_size) {
+                        printf("the object is larger than %ld\n", unit_size);
+                        exit(-1);
+                    }
+                    sym[0] = id[Class];
+                    sym[1] = id[Type];
+                    sym[2] = 0;
+                    if (id[Class] == Fun) {
+                        sym[2] = (int*)id[Value] - old_text;
+                    } else if (id[Class] == Glo) {
+                        sym[2] = id[Value] - (int)old_data;
+                    }
+                    d = (char*)(sym + 3);
+                    while ((*d++ = *name++)) {
+                    }
+                    sym = symbol_of(sym);
+                }
+                n++;
+            }
+            i++;
+        }
+        if (pass == 0) {
+            if (bc_size() > unit_size) {
+                printf("the object is larger than %ld\n", unit_size);
+                exit(-1);
+            }
+            head[11] = bc_image(obj, 0);
+            head[12] = n;
+            sym = (int*)(obj + head[11]);
+        }
+        pass++;
+    }
+}
+
+// the child process of a unit
+int compile_unit(char* path, char* obj) {
+    open_source(path);
+    program();
+    write_object(obj);
+    return 0;
+}
+
+// the identifier of a symbol of an object, in the symbol table of cc
+int* lookup(int* sym) {
+    src = (char*)(sym + 3);
+    next();
+    return current_id;
+}
+
+// place the object at head after the code and the data which are already
+// linked, its functions and globals become symbols of cc. base gets the
+// offsets of its code and data and the count of its merged globals
+void place_object(int* head, int* base) {
+    int *p, *id, *sym, i;
+    char* d;
+
+    base[0] = text - old_text;
+    if (text + head[4] > text_end) {
+        printf("text segment is full (-mtext=%ld)\n", text_size);
+        exit(-1);
+    }
+    p = (int*)((char*)head + BcPage) + 1;
+    i = 1;
+    while (i < head[4]) {
+        *++text = *p++;
+        i++;
+    }
+    data = (char*)(((int)data + sizeof(int) - 1) & -sizeof(int));
+    base[1] = data - old_data;
+    check_data(head[5]);
+    d = (char*)head + head[7];
+    i = 0;
+    while (i < head[5]) {
+        *data++ = *d++;
+        i++;
+    }
+
+    sym = (int*)((char*)head + head[11]);
+    i = 0;
+    while (i < head[12]) {
+        if (sym[0] == Fun || sym[0] == Glo) {
+            id = lookup(sym);
+            if (id[Class] == Fun && sym[0] == Fun) {
+                printf("duplicate function %s\n", (char*)(sym + 3));
+                exit(-1);
+            }
+            if (sym[0] == Fun) {
+                id[Class] = Fun;
+                id[Type] = sym[1];
+                id[Value] = (int)(old_text + base[0] + sym[2]);
+            } else if (id[Class] != Glo) {
+                id[Class] = Glo;
+                id[Type] = sym[1];
+                id[Value] = (int)(old_data + base[1] + sym[2]);
+            } else {
+                // merged, the symbol keeps the address of the global
+                sym[0] = -Glo;
+                sym[1] = id[Value];
+                base[2]++;
+            }
+        }
+        sym = symbol_of(sym);
+        i++;
+    }
+}
+
+// move the addresses of the object at head to where it was placed, after
+// every object is placed
+void relocate_object(int* head, int* base) {
+    int *p, *end, *rel, *sym, *id, *calls, i, n;
+
+    // the address of each function which the unit calls
+    if (!(calls = malloc(head[12] * sizeof(int)))) {
+        printf("could not malloc(%ld) for symbols\n", head[12] * sizeof(int));
+        exit(-1);
+    }
+    sym = (int*)((char*)head + head[11]);
+    i = 0;
+    while (i < head[12]) {
+        if (sym[0] == Ext) {
+            id = lookup(sym);
+            if (id[Class] != Fun) {
+                printf("undefined function %s\n", (char*)(sym + 3));
+                exit(-1);
+            }
+            calls[i] = id[Value];
+        }
+        sym = symbol_of(sym);
+        i++;
+    }
+
+    rel = (int*)((char*)head + head[8]);
+    end = rel + head[9];
+    while (rel < end) {
+        p = old_text + base[0] + (*rel >> 2);
+        if ((*rel & 3) == BcText) {
+            *p = (int)(old_text + base[0] + *p);
+        } else if ((*rel & 3) == BcData) {
+            n = *p;
+            *p = (int)(old_data + base[1] + n);
+            if (base[2]) {
+                sym = (int*)((char*)head + head[11]);
+                i = 0;
+                while (i < head[12]) {
+                    if (sym[0] == -Glo && sym[2] == n) {
+                        *p = sym[1];
+                    }
+                    sym = symbol_of(sym);
+                    i++;
+                }
+            }
+        } else {
+            *p = calls[*p];
+        }
+        rel++;
+    }
+}
+
+// compile the units in parallel and link them
+int link_units() {
+    char* objs;
+    int *pids, *bases, i, status, failed;
+
+    unit_size = 2 * text_size + data_size + BcPage;
+    // MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE
+    objs = (char*)mmap(0, unit_count * unit_size, 3, 0x4021, -1, 0);
+    if ((int)objs == -1 || !(pids = malloc(unit_count * sizeof(int))) ||
+        !(bases = malloc(unit_count * 3 * sizeof(int)))) {
+        printf("could not mmap(%ld) for objects\n", unit_count * unit_size);
+        return -1;
+    }
+    i = 0;
+    while (i < unit_count) {
+        if (!(pids[i] = fork())) {
+            exit(compile_unit(units[i], objs + i * unit_size));
+        }
+        if (pids[i] < 0) {
+            printf("could not fork() for %s\n", units[i]);
+            return -1;
+        }
+        i++;
+    }
+    failed = 0;
+    i = 0;
+    while (i < unit_count) {
+        status = 0;
+        if (waitpid(pids[i], (void*)&status, 0) != pids[i] || status) {
+            failed = 1;
+        }
+        i++;
+    }
+    if (failed) {
+        return -1;
+    }
+
+    i = 0;
+    while (i < unit_count) {
+        bases[i * 3 + 2] = 0;
+        place_object((int*)(objs + i * unit_size), bases + i * 3);
+        i++;
+    }
+    i = 0;
+    while (i < unit_count) {
+        relocate_object((int*)(objs + i * unit_size), bases + i * 3);
+        i++;
+    }
+    return 0;
+}
+
+// the limits of the segments and the optimization level, before the options
+void init_limits() {
+    opt = 1;
+    text_size = 64 * 1024 * 1024;
+    data_size = 64 * 1024 * 1024;
+    stack_size = 8 * 1024 * 1024;
+    poolsize = 256 * 1024;
+}
+
+// a new symbol table with the keywords and the builtins
+void init_symbols() {
+    int i;
+
+    line = 1;
+    sym_mask = 1023;
+    if (!(sym_index = malloc((sym_mask + 1) * sizeof(int)))) {
+        printf("could not malloc(%ld) for symbol index\n",
+               (sym_mask + 1) * sizeof(int));
+        exit(-1);
+    }
+    memset(sym_index, 0, (sym_mask + 1) * sizeof(int));
+
+    if (!(scopes = scope_top = malloc(256 * ScopeSize * sizeof(int)))) {
+        printf("could not malloc(%ld) for scope stack\n",
+               256 * ScopeSize * sizeof(int));
+        exit(-1);
+    }
+    scope_end = scopes + 256 * ScopeSize;
+
+    if (!(cases = case_top = malloc(poolsize))) {
+        printf("could not malloc(%ld) for case labels\n", poolsize);
+        exit(-1);
+    }
+    case_end = cases + poolsize / sizeof(int);
+
+    if (!(loops = (int*)reserve(0, text_size))) {
+        printf("could not mmap(%ld) for loops\n", text_size);
+        exit(-1);
+    }
+    loop_max = text_size / sizeof(int) / LoopSize;
+    loop_count = addressed = unrolling = 0;
+
+    if (!(nodes = node_pos = (int*)reserve(0, text_size))) {
+        printf("could not mmap(%ld) for nodes\n", text_size);
+        exit(-1);
+    }
+    node_end = nodes + text_size / sizeof(int);
+
+    // init the keyword in symbol table
+    src =
+        "break case char default else enum if int return sizeof switch while "
+        "open read write close printf malloc memset memcmp mmap madvise lseek "
+        "fork waitpid dlsym jitcall exit void main";
+
+    // add keywords to symbol table
+    i = Break;
+    while (i <= While) {
+        next();
+        current_id[Token] = i++;
+    }
+
+    // add library to symbol table
+    i = OPEN;
+    while (i <= EXIT) {
         next();
         current_id[Class] = Sys;
         current_id[Type] = INT;
@@ -1431,36 +6949,116 @@ int main(int argc, char** argv) {
     current_id[Token] = Char;  // handle void type
     next();
     idmain = current_id;  // keep track of main
+}
 
-    // open the source file
-    if ((fd = open(*argv, 0)) < 0) {
-        printf("could not open(%s)\n", *argv);
-        return -1;
+// the embedding API: cc_compile compiles a source into an image, which is
+// not changed after, and cc_instance makes an instance of an image with its
+// own stack and its own copy of the data segment. the text of an image is
+// shared by its instances, with the addresses in the data segment relative
+// to the data of the instance (see IMD), so that the instances can run at
+// the same time on different threads. the compiler itself keeps its state
+// in globals, one source is compiled at a time.
+enum { ImText, ImMain, ImData, ImDataSize, ImageSize };
+
+// make the program in the segments an image. the operands which hold an
+// address in the data segment are made relative to it, only IMM and the
+// global loads and stores have one (see fuse_ops)
+int* cc_image() {
+    int *image, *p, *q;
+
+    if (!(image = malloc(ImageSize * sizeof(int)))) {
+        printf("could not malloc(%ld) for image\n", ImageSize * sizeof(int));
+        return 0;
     }
-
-    // init the segment and stack space
-    if (!(src = old_src = malloc(poolsize))) {
-        printf("could not malloc(%d) for source area\n", poolsize);
-        return -1;
+    p = old_text + 1;
+    while (p <= text) {
+        q = data_operand(p);
+        if (q && (*p == LGI || *p == LGC || *p == SGI || *p == SGC ||
+                  (*p == IMM && is_data(*q)))) {
+            if (*p == IMM) {
+                *p = IMD;
+            } else if (*p == LGI) {
+                *p = LDI;
+            } else if (*p == LGC) {
+                *p = LDC;
+            } else if (*p == SGI) {
+                *p = SDI;
+            } else {
+                *p = SDC;
+            }
+            *q = *q - (int)old_data;
+        }
+        p = next_op(p);
     }
+    image[ImText] = (int)old_text;
+    image[ImMain] = idmain[Value];
+    image[ImData] = (int)old_data;
+    image[ImDataSize] = data - old_data;
+    return image;
+}
 
-    // read the source file
-    if ((i = read(fd, src, poolsize - 1)) <= 0) {
-        printf("read() returned %d\n", i);
-        return -1;
+// compile the source, a string, into an image in new segments. returns 0
+// when main is not defined, the errors of the source exit as in cc
+int* cc_compile(char* source) {
+    if (!text_size) {
+        init_limits();
     }
-    src[i] = 0;  // add EOF character
-    close(fd);
-
+    init_symbols();
+    if (!(text = old_text = (int*)reserve(0, text_size)) ||
+        !(data = old_data = reserve(0, data_size))) {
+        printf("could not mmap(%ld) for segments\n", text_size + data_size);
+        return 0;
+    }
+    text_end = old_text + text_size / sizeof(int) - 256;
+    data_end = data + data_size;
+    labels = 0;
+    src = source;
+    src_end = 0;
     program();
-
-    if (!(pc = (int*)idmain[Value])) {
+    if (check_defined()) {
+        return 0;
+    }
+    if (opt > 0) {
+        optimize();
+    }
+    if (!idmain[Value]) {
         printf("main() not defined\n");
-        return -1;
+        return 0;
+    }
+    return cc_image();
+}
+
+// an instance of the image, it starts with the data of the image
+int* cc_instance(int* image) {
+    int* in;
+    char *d, *p;
+
+    if (!(in = malloc(InstanceSize * sizeof(int))) ||
+        !(in[InStack] = (int)reserve(0, stack_size)) ||
+        !(in[InData] = (int)malloc(image[ImDataSize] + 1))) {
+        printf("could not make an instance, the stack is %ld\n", stack_size);
+        return 0;
     }
+    if (huge) {
+        madvise((char*)in[InStack], stack_size, 14);  // MADV_HUGEPAGE
+    }
+    in[InImage] = (int)image;
+    in[InCycle] = 0;
+    d = (char*)in[InData];
+    p = (char*)image[ImData];
+    while (p < (char*)image[ImData] + image[ImDataSize]) {
+        *d++ = *p++;
+    }
+    return in;
+}
+
+// run main of the instance, returns its exit code
+int cc_run(int* in, int argc, char** argv) {
+    int *sp, *tmp, *pc, ret;
 
     // setup stack
-    sp = (int*)((int)stack + poolsize);
+    // the stack starts from high address to low address
+    sp = (int*)(in[InStack] + stack_size);
     *--sp = EXIT;  // call exit if main returns
     *--sp = PUSH;
     tmp = sp;
@@ -1468,5 +7066,254 @@ int main(int argc, char** argv) {
     *--sp = (int)argv;
     *--sp = (int)tmp;
 
-    return eval();
-}
\ No newline at end of file
+    // the instrumented interpreter only when it is needed
+    pc = (int*)((int*)in[InImage])[ImMain];
+    if (regs) {
+        return eval_reg(pc, sp, in);
+    }
+    if (!debug && !prof && !trace_fd) {
+        return eval(pc, sp, in);
+    }
+    ret = eval_trace(pc, sp, in);
+    if (trace_fd) {
+        trace_flush();
+        close(trace_fd);
+        trace_fd = 0;
+    }
+    return ret;
+}
+
+// the main function, left out when cc is built into a program which uses
+// the embedding API
+#ifndef CC_EMBED
+int main(int argc, char** argv) {
+    int i, fd, n, key;
+    int *tmp, *pc;
+    char* v;
+
+    argc--;
+    argv++;
+
+    // options: -O0, -O1 or -O2 (which also unrolls loops) for the
+    // optimization level, -d for the debug mode,
+    // -j to run the program as native code, -p to profile it in the
+    // interpreter, -s to print the count of instructions it executed,
+    // -n to only parse it and print the tokens, lines and segment use,
+    // -r to run it as register code,
+    // -o to write it as an executable
+    // or as C source or bytecode (when the name ends with .c or .bc),
+    // -trace=file to write a binary trace of the interpreter, which cc
+    // prints when the file is given instead of a source,
+    // -cache=dir to keep the bytecode of every source in dir, -u file for
+    // another translation unit, -m<segment>=<size> for the limits of the
+    // segments and -mhuge for huge pages
+    if (!(units = malloc((argc + 1) * sizeof(int)))) {
+        printf("could not malloc(%ld) for units\n", (argc + 1) * sizeof(int));
+        return -1;
+    }
+    init_limits();
+    while (argc > 0 && **argv == '-' && (*argv)[1]) {
+        if ((*argv)[1] == 'O') {
+            opt = (*argv)[2] - '0';
+            if (opt < 0 || opt > 2 || (*argv)[3]) {
+                argc = 0;  // print the usage
+                break;
+            }
+        } else if ((*argv)[1] == 'd') {
+            debug = 1;
+        } else if ((*argv)[1] == 'j') {
+            jit = 1;
+        } else if ((*argv)[1] == 'p') {
+            prof = 1;
+        } else if ((*argv)[1] == 's') {
+            stats = 1;
+        } else if ((*argv)[1] == 'n') {
+            parse_only = 1;
+        } else if ((*argv)[1] == 'r') {
+            regs = 1;
+        } else if ((*argv)[1] == 'o' && argc > 1) {
+            argc--;
+            argv++;
+            output = *argv;
+        } else if ((*argv)[1] == 'u' && argc > 1) {
+            argc--;
+            argv++;
+            units[unit_count++] = *argv;
+        } else if ((v = option(*argv, "-trace="))) {
+            trace_path = v;
+        } else if ((v = option(*argv, "-cache="))) {
+            cache = v;
+        } else if ((v = option(*argv, "-mtext="))) {
+            text_size = parse_size(v);
+        } else if ((v = option(*argv, "-mdata="))) {
+            data_size = parse_size(v);
+        } else if ((v = option(*argv, "-mstack="))) {
+            stack_size = parse_size(v);
+        } else if ((v = option(*argv, "-mhuge")) && !*v) {
+            huge = 1;
+        } else {
+            printf("unknown option %s\n", *argv);
+            return -1;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc < 1) {
+        printf("usage: cc [-O0|-O1|-O2] [-d] [-j] [-p] [-s] [-n] [-r] [-trace=file] [-o output] "
+               "[-cache=dir] [-u unit] [-m{text,data,stack}=size] [-mhuge] "
+               "file|- ...\n");
+        return -1;
+    }
+    if (regs && (debug || prof || trace_path || jit || output)) {
+        printf("the register code only runs in the interpreter, without -d, "
+               "-p, -trace, -j or -o\n");
+        return -1;
+    }
+    if (text_size <= 0 || data_size <= 0 || stack_size <= 0) {
+        printf("bad size of a segment\n");
+        return -1;
+    }
+    if (output && ends_with(output, ".c")) {
+        c_output = output;
+        output = 0;
+    } else if (output && ends_with(output, ".bc")) {
+        bc_output = output;
+        output = 0;
+    }
+    if ((jit || output) && sizeof(int) != 8) {
+        printf("native code needs the 64-bit build of cc\n");
+        return -1;
+    }
+
+    // reserve the segments of the virtual machine, the symbol table gets its
+    // first pool with the first identifier. the stack is reserved for each
+    // instance
+    if (!(text = old_text = (int*)reserve(0, text_size))) {
+        printf("could not mmap(%ld) for text segment area\n", text_size);
+        return -1;
+    }
+    text_end = old_text + text_size / sizeof(int) - 256;
+    if (output) {
+        // the executable loads the data segment at the same address, the
+        // first free one of ElfData, 2 * ElfData, ... (when cc is such an
+        // executable, its own data segment is at ElfData)
+        i = ElfData;
+        while (!(data = reserve(i, data_size)) && i < 4 * ElfData) {
+            i = i + ElfData;
+        }
+    } else {
+        data = reserve(0, data_size);
+    }
+    if (!data) {
+        printf("could not mmap(%ld) for data segment area\n", data_size);
+        return -1;
+    }
+    old_data = data;
+    data_end = data + data_size;
+    if (huge) {
+        madvise((char*)text, text_size, 14);  // MADV_HUGEPAGE
+    }
+
+    init_symbols();
+
+    // the source file. a file of bytecode is loaded instead, and so is the
+    // bytecode of the source in the cache. with other units, the file is
+    // one of them
+    key = 0;
+    if (prof && !(line_map = (int*)reserve(0, 2 * text_size))) {
+        printf("could not mmap(%ld) for lines\n", 2 * text_size);
+        return -1;
+    }
+    if (unit_count) {
+        units[unit_count++] = *argv;
+        if (link_units() < 0) {
+            return -1;
+        }
+    } else {
+        fd = open_source(*argv);
+        if ((n = lseek(fd, 0, 2)) >= 0) {  // SEEK_END
+            if (n >= 4 * sizeof(int) && *(int*)src == TraceMagic) {
+                return print_trace((int*)src, n);
+            }
+            if (n >= BcPage && *(int*)src == BcMagic) {
+                if (!load_bc(fd, 0)) {
+                    printf("%s is bytecode of another version of cc\n", *argv);
+                    return -1;
+                }
+                src = 0;
+            } else if (cache) {
+                key = source_key(src, n);
+                if ((i = open(cache_path(key), 0)) >= 0) {
+                    if (load_bc(i, key)) {
+                        src = 0;
+                    }
+                    close(i);
+                }
+            }
+            close(fd);
+        }
+        if (src) {
+            program();
+            if (check_defined()) {
+                return -1;
+            }
+        }
+    }
+    if (parse_only) {
+        printf("tokens(%ld) lines(%ld) text(%ld) data(%ld) symbols(%ld)\n",
+               tokens, line, (text - old_text) * sizeof(int),
+               data - old_data, sym_count);
+        return 0;
+    }
+    if (src && opt > 0) {
+        optimize();
+    }
+
+    if (!(pc = (int*)idmain[Value])) {
+        printf("main() not defined\n");
+        return -1;
+    }
+
+    if (key && src) {
+        write_bc(cache_path(key), key);
+    }
+    if (bc_output) {
+        return write_bc(bc_output, 0);
+    }
+    if (c_output) {
+        if (!src) {
+            printf("C output needs the source of the program\n");
+            return -1;
+        }
+        return write_c(c_output);
+    }
+    if (output) {
+        return write_elf(output);
+    }
+    if (jit) {
+        return jit_run(argc, argv);
+    }
+
+    // interpret the program as an instance of its image
+    if (prof) {
+        prof_setup();
+    }
+    if (regs) {
+        to_registers();
+    }
+    if (!(tmp = cc_image()) || !(tmp = cc_instance(tmp))) {
+        return -1;
+    }
+    if (trace_path) {
+        trace_open(trace_path);
+    }
+    n = cc_run(tmp, argc, argv);
+    if (prof) {
+        prof_report(tmp[InCycle]);
+    }
+    if (stats) {
+        printf("instructions(%ld)\n", tmp[InCycle]);
+    }
+    return n;
+}
+#endif
@@ -68,13 +68,13 @@ void test_number() {
     c = 2147483648;
 
     test(INT_MAX, b);
-    test(INT_MIN, c);
+    test(INT_MAX + 1, c);
 
     b = -2147483648;
     c = -2147483649;
 
     test(INT_MIN, b);
-    test(INT_MAX, c);
+    test(INT_MIN - 1, c);
 
     b = 1;
     c = -1;
@@ -102,13 +102,13 @@ void test_number() {
     c = 020000000000;
 
     test(INT_MAX, b);
-    test(INT_MIN, c);
+    test(INT_MAX + 1, c);
 
     b = -020000000000;
     c = -020000000001;
 
     test(INT_MIN, b);
-    test(INT_MAX, c);
+    test(INT_MIN - 1, c);
 
     b = 01;
     c = -01;
@@ -136,13 +136,13 @@ void test_number() {
     c = 0x80000000;
 
     test(INT_MAX, b);
-    test(INT_MIN, c);
+    test(INT_MAX + 1, c);
 
     b = -0x80000000;
     c = -0x80000001;
 
     test(INT_MIN, b);
-    test(INT_MAX, c);
+    test(INT_MIN - 1, c);
 
     b = 0x1;
     c = -0x1;
@@ -170,13 +170,13 @@ void test_number() {
     c = 0X80000000;
 
     test(INT_MAX, b);
-    test(INT_MIN, c);
+    test(INT_MAX + 1, c);
 
     b = -0X80000000;
     c = -0X80000001;
 
     test(INT_MIN, b);
-    test(INT_MAX, c);
+    test(INT_MIN - 1, c);
 
     b = 0X1;
     c = -0X1;
@@ -243,6 +243,15 @@ void test_operator() {
     test(2, a / b);
     test(1, a % b);
 
+    // division and modulo by constants are shifts or multiplies
+    a = -9;
+    test(-2, a / 4);
+    test(-1, a % 4);
+    test(-1, a / 7);
+    test(-2, a % 7);
+    test(3, -a / 3);
+    test(-36, a * 4);
+
     assert((char*)"operator |");
 
     assert((char*)"operator ^");
@@ -312,14 +321,46 @@ void test_pointer() {
     test(i, (int)***ppp);
 
     test(i, (int)*&*&*p);
+    test(3, (p + 3) - p);
+    test(-2, p - (p + 2));
+
+    // the address of a global is compared in the data of the program
+    p = &ONE;
+    test(TRUE, p == &ONE);
+    test(FALSE, p != &ONE);
+    test(1, &INT_MAX - p);
+    if (p == &ONE) {
+        i = 1;
+    }
+    test(1, i);
 }
 
 void test_expression() {
+    int x;
+
     assert((char*)"expression");
+    x = 3;
+
+    // constant operands are folded by the compiler
+    test(21, 1 + 2 * 10);
+    test(-3, -1 * x);
+    test(4 * sizeof(int), sizeof(int) * 4);
+    test(3, B | C);
+    test(TRUE, !0);
+    test(FALSE, !C);
+    test(MINUS_ONE, ~0);
+    test(16, 1 << 4);
+    test(TRUE, 2 < 3 == 1);
+    test(x, 1 ? x : 9);
+    test(9, 0 ? x : 9);
+    test(FALSE, 0 && x);
+    test(TRUE, (1 || x) == 1);
+    test(x + 6, (x + 1) + 5);
+    test(x, x * 1 + 0);
 }
 
 void test_control_flows() {
-    int a, b;
+    int a, b, c;
     assert((char*)"while loop");
     a = 0;
     b = 1;
@@ -343,6 +384,110 @@ void test_control_flows() {
     } else {
         test(FALSE, b);
     }
+
+    // constant conditions, the dead statements are removed
+    a = 0;
+    if (0) {
+        a = 1;
+    } else if (1) {
+        a = 2;
+    }
+    while (1) {
+        a++;
+        if (a == 5) {
+            break;
+        }
+    }
+    while (0) {
+        a = 9;
+    }
+    test(5, a);
+
+    // a counted loop with an invariant expression
+    a = b = 0;
+    c = 3;
+    while (a < c * 4) {
+        b = b + c * 5;
+        a++;
+    }
+    test(180, b);
+}
+
+int classify(int x) {
+    int r;
+    r = 0;
+    switch (x) {
+        case -1:
+            r = 10;
+            break;
+        case 0:
+        case 1:
+            r = 20;
+            break;
+        case C:
+            r = 30;
+        case 3:
+            r = r + 1;
+            break;
+        default:
+            r = 40;
+    }
+    return r;
+}
+
+// too sparse for a jump table
+int sparse(int x) {
+    switch (x) {
+        case 1000:
+            return 3;
+        case -7:
+            return 1;
+        case 0:
+            return 2;
+        case 100000:
+            return 4;
+    }
+    return 0;
+}
+
+void test_switch() {
+    int a, b;
+    assert((char*)"switch");
+    test(10, classify(-1));
+    test(20, classify(0));
+    test(20, classify(1));
+    test(31, classify(1 + 1));
+    test(1, classify(3));
+    test(40, classify(4));
+    test(40, classify(-2));
+    test(1, sparse(-7));
+    test(2, sparse(0));
+    test(3, sparse(1000));
+    test(4, sparse(100000));
+    test(0, sparse(999));
+    test(0, sparse(-8));
+
+    assert((char*)"break");
+    a = 0;
+    while (1) {
+        if (a == 5) {
+            break;
+        }
+        a++;
+    }
+    test(5, a);
+
+    a = b = 0;
+    while (a < 3) {
+        switch (a) {
+            case 1:
+                break;
+            default:
+                b = b + 1;
+        }
+        a++;
+    }
+    test(2, b);
 }
 
 int func1(int x) {
@@ -365,6 +510,37 @@ void test_function() {
     func3();
 }
 
+int is_odd(int n);
+
+int is_even(int n) {
+    return n == 0 ? 1 : is_odd(n - 1);
+}
+
+int is_odd(int n) {
+    return n == 0 ? 0 : is_even(n - 1);
+}
+
+// a tail call, deeper than the stack would allow for the frames
+int count_down(int n, int acc) {
+    if (n == 0) {
+        return acc;
+    }
+    return count_down(n - 1, acc + 1);
+}
+
+int deref(int* p) {
+    int y;
+    y = 7;
+    return *p;
+}
+
+// not a tail call, the callee reads a local of the caller
+int pass_local(int a) {
+    int x;
+    x = a;
+    return deref(&x);
+}
+
 int factorial(int i) {
     if (i < 2) {
         return i;
@@ -376,6 +552,10 @@ int factorial(int i) {
 void test_recursive() {
     assert((char*)"recursive");
     test(3628800, factorial(10));
+    test(1, is_even(10));
+    test(1, is_odd(7));
+    test(300000, count_down(300000, 0));
+    test(42, pass_local(42));
 }
 
 int main() {
@@ -388,6 +568,7 @@ int main() {
     test_pointer();
     test_expression();
     test_control_flows();
+    test_switch();
     test_function();
     test_recursive();
     analyze();